@@ -24,17 +24,37 @@ SOFTWARE.
 
 #pragma once
 
+#include <iosfwd>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <stb_image.h>
 #include <tinycolormap.hpp>
 
+#include "ColormapLut.hpp"
+#include "Image.hpp"
+#include "ImageWriters.hpp"
+#include "PngWriter.hpp"
+
 struct ImageMetadata
 {
 	int width;
 	int height;
 	int nr_channels = 3;
+
+	/* As stored in the file, filled in by read_metadata() */
+	int nr_channels_in_file = 0;
+
+	/* 8 or 16, read_metadata() reports the file's depth and decode_image() decodes to this depth */
+	int bit_depth = 8;
+};
+
+/* A reference image converted to what a comparator works on, read-only so comparisons may share it */
+struct PreparedReference
+{
+	virtual ~PreparedReference() = default;
 };
 
 class BaseComparator
@@ -43,27 +63,84 @@ public:
     BaseComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges);
     virtual ~BaseComparator();
     
-    virtual void compare(const std::vector<uint8_t> & ref_img, const std::vector<uint8_t> & src_image) = 0;
+    /* Computes the error map and the metric, the images aren't needed anymore afterwards */
+    virtual void compare(const ImageView& ref_img, const ImageView& src_image) = 0;
     virtual double get_error() const = 0;
 
-    static std::vector<uint8_t> load_image(const std::string& filename, ImageMetadata& img_data);
-    static std::vector<double> luma(const std::vector<uint8_t>& img);
+    /* Writes the diff image of the last compare(), returns false if it couldn't be written */
+    virtual bool save() = 0;
+
+    /*
+     * Converts the reference once (normalized luma, L*a*b*), so that compare() with the result only has to
+     * process the source. It may only be passed to comparators of the same type, precision and image size.
+     */
+    virtual std::shared_ptr<const PreparedReference> prepare_reference(const ImageView& ref_img) const = 0;
+    virtual void compare(const PreparedReference& ref, const ImageView& src_image) = 0;
+
+    /* Prints comparator-specific statistics for --verbose, nothing by default */
+    virtual void print_stats(std::ostream& out) const;
+
+    /* Writes the diff image of two identical images (zero error everywhere) without comparing anything */
+    bool save_identical();
+
+    /* Format of the diff image, its extension is appended to out_filename ("-" writes to stdout). PNG by default */
+    void set_output_format(OutputFormat output_format) { m_output_format = output_format; }
 
-    /* Performs linear normalization: https://en.wikipedia.org/wiki/Normalization_(image_processing) */
-    static std::vector<double> normalize_image_linear(const std::vector<double>& img, double new_min, double new_max);
+    /* Encoder settings for PNG diff images, PngSpeed::Fast by default */
+    void set_png_speed(PngSpeed png_speed) { m_png_speed = png_speed; }
+
+    /*
+     * Reads only the image header (size, channels, bit depth) of the file or of encoded data in memory,
+     * returns false if it isn't a supported image
+     */
+    static bool read_metadata(const std::string& filename, ImageMetadata& img_data);
+    static bool read_metadata(const ImageView& encoded, ImageMetadata& img_data);
+
+    /* Returns an empty image if the data couldn't be decoded */
+    static Image decode_image(const ImageView& encoded, ImageMetadata& img_data);
+
+    /* The templated helpers below are instantiated for float and double */
+    template<typename T>
+    static std::vector<T> luma(const ImageView& img);
+
+    /* Returns the smallest and the largest value of img, {0, 0} for an empty image */
+    template<typename T>
+    static std::pair<T, T> image_min_max(const std::vector<T>& img);
 
     /* 
      * RGB -> XYZ -> L*a*b* conversion based on:
      * http://www.easyrgb.com/en/math.php 
      */
-    static std::vector<double> rgb_2_lab(const std::vector<uint8_t>& img);
+    template<typename T>
+    static std::vector<T> rgb_2_lab(const ImageView& img);
 
 protected:
-    virtual void save_diff_image(const std::vector<double> & error_img);
+    /* 
+     * Images are processed in tiles of tile_size pixels spread over ThreadPool::global().
+     * The split doesn't depend on the thread count and per-tile partial sums are combined in tile order,
+     * so the metrics are bit-identical for any --threads value.
+     */
+    static constexpr size_t tile_size = size_t(1) << 16;
+
+    static size_t num_tiles(size_t num_pixels)
+    {
+        return (num_pixels + tile_size - 1) / tile_size;
+    }
+
+    /*
+     * Writes the error map in m_output_format. Colormapped formats show the error normalized
+     * from [min_error, max_error] to [0, 1], float formats store error_img unchanged.
+     * Returns false if the file couldn't be opened or written.
+     */
+    template<typename T>
+    bool save_diff_image(const std::vector<T>& error_img, T min_error, T max_error);
 
     std::string m_out_filename;
     tinycolormap::ColormapType m_colormap_type;
     unsigned m_width;
     unsigned m_height;
     int m_interpolation_ranges;
+    std::shared_ptr<const ColormapLut> m_colormap_lut;
+    OutputFormat m_output_format = OutputFormat::Png;
+    PngSpeed m_png_speed = PngSpeed::Fast;
 };
\ No newline at end of file
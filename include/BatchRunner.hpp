@@ -0,0 +1,74 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "ImageComparison.hpp"
+
+/*
+ * Threads of each pipeline stage, 0 means one per hardware thread. Pairs are decoded, then compared,
+ * then their diff images are encoded and written; compare and encode still spread their work over
+ * ThreadPool::global().
+ */
+struct PipelineJobs
+{
+    unsigned decode  = 0;
+    unsigned compare = 0;
+    unsigned encode  = 0;
+};
+
+/*
+ * Compares every pair listed in a JSON Lines manifest ("-" reads it from stdin) within this process.
+ * Each record is an object with "ref", "src" and "out" paths and optionally "mode" and "colormap",
+ * which override the ones in settings; an extension of "out" overrides settings.output_format.
+ *
+ * One JSON result line per record is written to results as soon as the pair is done, so lines come
+ * in completion order and carry the manifest line number.
+ * A throughput summary is printed to log at the end. Returns false if any record failed.
+ */
+bool run_batch(const std::string& manifest_filename, const ComparisonSettings& settings, PipelineJobs jobs, std::ostream& results, std::ostream& log);
+
+/*
+ * Compares the images of two directory trees (stb_image formats, matched by relative path) the same way,
+ * writing each diff to out_directory/<relative path> with the output format's extension. Images present in
+ * only one tree are reported first as {"path": ..., "status": "missing_src"} or "missing_ref" lines.
+ * Pairs whose diffs would have the same path (a.png and a.jpg) and pairs whose output directory can't be
+ * created are reported as errors without being compared.
+ * Returns false if any pair failed or any image was missing.
+ */
+bool run_directory_diff(const std::string& ref_directory, const std::string& src_directory, const std::string& out_directory, const ComparisonSettings& settings,
+                        PipelineJobs jobs, std::ostream& results, std::ostream& log);
+
+/*
+ * Compares every source with one reference, which is decoded and converted only once and stays in memory
+ * while the sources stream through the same pipeline. The diff of the i-th source (counting from 1) is
+ * written to <out_filename>_<i> and its result line carries "index": i. All sources are compared at the
+ * depth of the deepest one. Returns false if the reference or any source failed.
+ */
+bool run_reference_diff(const std::string& ref_filename, MappedFile ref_file, const std::vector<std::string>& src_filenames, const std::string& out_filename,
+                        const ComparisonSettings& settings, PipelineJobs jobs, std::ostream& results, std::ostream& log);
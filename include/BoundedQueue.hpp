@@ -0,0 +1,190 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's ring buffer with per-cell
+ * sequence numbers). push() blocks while the queue is full, which throttles producers to the pace
+ * of the consumers. Waiting threads spin briefly and then sleep with a growing back-off.
+ */
+template<typename T>
+class BoundedQueue
+{
+public:
+    /* The capacity is rounded up to a power of two */
+    explicit BoundedQueue(size_t capacity)
+    {
+        size_t size = 2;
+
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+
+        m_cells.reset(new Cell[size]);
+        m_mask = size - 1;
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /* Moves value into the queue, returns false without touching it when the queue is full */
+    bool try_push(T& value)
+    {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const ptrdiff_t diff = ptrdiff_t(sequence) - ptrdiff_t(pos);
+
+            if (diff == 0)
+            {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /* Returns false when the queue is empty */
+    bool try_pop(T& value)
+    {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const ptrdiff_t diff = ptrdiff_t(sequence) - ptrdiff_t(pos + 1);
+
+            if (diff == 0)
+            {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void push(T value)
+    {
+        for (Backoff backoff; !try_push(value); backoff.wait()) {}
+    }
+
+    /* Waits for an element, returns false once the queue is closed and empty */
+    bool pop(T& value)
+    {
+        for (Backoff backoff; !try_pop(value); backoff.wait())
+        {
+            /* Everything was pushed before close(), so one more attempt drains the queue */
+            if (m_closed.load(std::memory_order_acquire))
+            {
+                return try_pop(value);
+            }
+        }
+
+        return true;
+    }
+
+    /* Called by the last producer, no push() may follow */
+    void close()
+    {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    class Backoff
+    {
+    public:
+        void wait()
+        {
+            if (++m_spins <= 16)
+            {
+                std::this_thread::yield();
+                return;
+            }
+
+            std::this_thread::sleep_for(m_sleep);
+            m_sleep = std::min(m_sleep * 2, std::chrono::microseconds(1000));
+        }
+
+    private:
+        int m_spins = 0;
+        std::chrono::microseconds m_sleep { 10 };
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+
+    /* On separate cache lines, producers and consumers don't contend */
+    alignas(64) std::atomic<size_t> m_enqueue_pos { 0 };
+    alignas(64) std::atomic<size_t> m_dequeue_pos { 0 };
+    alignas(64) std::atomic<bool>   m_closed { false };
+};
@@ -0,0 +1,194 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/* 
+ * Per-pixel RGB -> XYZ -> L*a*b* conversion (D65/2 deg standard illuminant) based on:
+ * http://www.easyrgb.com/en/math.php
+ *
+ * The sRGB gamma curve is read from a 256-entry table built at compile time and the XYZ -> Lab
+ * cube root uses a bit-level estimate refined with Halley's method instead of std::pow.
+ * Compared to the std::pow formulation every L*, a* and b* component of every 8-bit RGB triple
+ * differs by less than 5e-12, so per-pixel delta E values agree to within 2e-11.
+ * With T = float the components stay within 2e-4 of it (a* and b* amplify the cube root error by 500).
+ *
+ * 16-bit components go through a 65536-entry table built on first use. Since v / 255 and 257 * v / 65535
+ * round to the same double, an 8-bit image widened to 16 bits converts to exactly the same values.
+ */
+namespace color
+{
+    namespace detail
+    {
+        /* x^(1/5) for x in (0, 1], Newton iteration from above until it stops decreasing */
+        constexpr double fifth_root(double x)
+        {
+            double y = 1.0;
+
+            while (true)
+            {
+                const double y2 = y * y;
+                const double next = (4.0 * y + x / (y2 * y2)) / 5.0;
+
+                if (next >= y)
+                {
+                    return y;
+                }
+
+                y = next;
+            }
+        }
+
+        /* x^2.4 = x^2 * (x^2)^(1/5) */
+        constexpr double pow_2_4(double x)
+        {
+            return x * x * fifth_root(x * x);
+        }
+
+        constexpr double srgb_to_linear(double comp)
+        {
+            return comp > 0.04045 ? pow_2_4((comp + 0.055) / 1.055) : comp / 12.92;
+        }
+
+        template<typename T>
+        constexpr std::array<T, 256> make_srgb_table()
+        {
+            std::array<T, 256> table{};
+
+            for (int i = 0; i < 256; ++i)
+            {
+                table[i] = static_cast<T>(srgb_to_linear(i / 255.0) * 100.0);
+            }
+
+            return table;
+        }
+    }
+
+    /* sRGB component -> linear value scaled to [0, 100] */
+    template<typename T>
+    inline constexpr std::array<T, 256> srgb_to_linear_table = detail::make_srgb_table<T>();
+
+    /* Same for 16-bit components, too large to be built at compile time */
+    template<typename T>
+    inline const T* srgb16_to_linear_table()
+    {
+        static const std::vector<T> table = []
+        {
+            std::vector<T> values(65536);
+
+            for (int i = 0; i < 65536; ++i)
+            {
+                values[i] = static_cast<T>(detail::srgb_to_linear(i / 65535.0) * 100.0);
+            }
+
+            return values;
+        }();
+
+        return table.data();
+    }
+
+    /* Cube root for positive, normal x. Relative error is below 1e-14. */
+    inline double fast_cbrt(double x)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+
+        /* Dividing the biased exponent by 3 gives an estimate within a few percent */
+        bits = bits / 3 + 0x2a9f7893782da1ceull;
+
+        double y;
+        std::memcpy(&y, &bits, sizeof(y));
+
+        /* Two Halley steps: cubic convergence takes the estimate close to full double precision */
+        for (int i = 0; i < 2; ++i)
+        {
+            const double y3 = y * y * y;
+            y = y * (y3 + 2.0 * x) / (2.0 * y3 + x);
+        }
+
+        return y;
+    }
+
+    /* Float variant of the above, relative error is below 3e-7 */
+    inline float fast_cbrt(float x)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+
+        bits = bits / 3 + 0x2a5137a0u;
+
+        float y;
+        std::memcpy(&y, &bits, sizeof(y));
+
+        for (int i = 0; i < 2; ++i)
+        {
+            const float y3 = y * y * y;
+            y = y * (y3 + 2.0f * x) / (2.0f * y3 + x);
+        }
+
+        return y;
+    }
+
+    template<typename T>
+    inline T lab_f(T t)
+    {
+        return t > T(0.008856) ? fast_cbrt(t) : (T(7.787) * t) + T(16.0 / 116.0);
+    }
+
+    /* r, g and b are linear and scaled to [0, 100] */
+    template<typename T>
+    inline void linear_rgb_to_lab(T r, T g, T b, T* lab)
+    {
+        /* XYZ normalized by the D65 reference white */
+        const T x = (r * T(0.4124) + g * T(0.3576) + b * T(0.1805)) / T(95.047);
+        const T y = (r * T(0.2126) + g * T(0.7152) + b * T(0.0722)) / T(100.000);
+        const T z = (r * T(0.0193) + g * T(0.1192) + b * T(0.9505)) / T(108.883);
+
+        const T fx = lab_f(x);
+        const T fy = lab_f(y);
+        const T fz = lab_f(z);
+
+        lab[0] = (T(116.0) * fy) - T(16.0);
+        lab[1] = T(500.0) * (fx - fy);
+        lab[2] = T(200.0) * (fy - fz);
+    }
+
+    template<typename T>
+    inline void rgb_to_lab(const uint8_t* rgb, T* lab)
+    {
+        linear_rgb_to_lab(srgb_to_linear_table<T>[rgb[0]], srgb_to_linear_table<T>[rgb[1]], srgb_to_linear_table<T>[rgb[2]], lab);
+    }
+
+    /* Hot loops should fetch the table once and pass it in */
+    template<typename T>
+    inline void rgb_to_lab(const uint16_t* rgb, T* lab, const T* table = srgb16_to_linear_table<T>())
+    {
+        linear_rgb_to_lab(table[rgb[0]], table[rgb[1]], table[rgb[2]], lab);
+    }
+}
@@ -0,0 +1,85 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+#include <tinycolormap.hpp>
+
+/* 
+ * A colormap baked into a dense RGB8 table, so mapping a value is a single gather
+ * instead of a tinycolormap::GetColor call per pixel. Values are rounded to the nearest entry.
+ *
+ * The table is accurate to rounding, not exact:
+ * - The table-based colormaps (Parula, Magma, Inferno, Plasma, Viridis, Cividis) step between their
+ *   256 colors at (k + 0.5) / 255, which are entry boundaries with 255 * 17 + 1 entries. Values are
+ *   exact except within rounding of a step, where they may get the neighboring color instead
+ *   (up to 5 levels away for Inferno and Cividis).
+ * - The interpolated ones (Heat, Jet, Hot, Gray, Github) truncate to 8 bits. A value and its entry are
+ *   at most 1/8670 apart, which moves no channel by a whole level (the steepest, Jet, changes by 4 per
+ *   unit), so values just across a truncation threshold from their entry are one level off.
+ *
+ * With interpolation_ranges > 0 the table is split into that many flat bands instead of
+ * being interpolated: band k of N gets the colormap color at k / (N - 1), so the lowest
+ * band keeps the colormap's first color and the highest band its last one.
+ */
+class ColormapLut
+{
+public:
+    static constexpr int size = 255 * 17 + 1;
+
+    ColormapLut(const tinycolormap::ColormapType& colormap_type, int interpolation_ranges);
+
+    /* Returns a cached table, each (colormap, ranges) pair is baked only once per process */
+    static std::shared_ptr<const ColormapLut> get(const tinycolormap::ColormapType& colormap_type, int interpolation_ranges);
+
+    /* Maps a value from [0, 1] to 3 bytes of RGB, values outside of the range are clamped */
+    template<typename T>
+    void lookup(T value, uint8_t* rgb) const
+    {
+        /* In double, so that float values are rounded to the entry GetColor's own rounding picks */
+        const double x = double(value);
+
+        int index = 0;
+
+        if (x >= 1.0)
+        {
+            index = size - 1;
+        }
+        else if (x > 0.0)
+        {
+            index = int(x * (size - 1) + 0.5);
+        }
+
+        rgb[0] = m_table[3 * index + 0];
+        rgb[1] = m_table[3 * index + 1];
+        rgb[2] = m_table[3 * index + 2];
+    }
+
+private:
+    std::array<uint8_t, 3 * size> m_table;
+};
@@ -0,0 +1,47 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define COLORIMGDIFF_X86 1
+#endif
+
+/* Instruction set extensions that have a dedicated kernel, ordered from the slowest to the fastest. */
+enum class SimdLevel
+{
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512
+};
+
+/* 
+ * Queries CPUID (and XGETBV for the OS-enabled register state) once and returns the best supported level.
+ * Setting the COLORIMGDIFF_SIMD environment variable to scalar, sse4.1, avx2 or avx512 caps the result,
+ * which is handy when comparing kernels against each other.
+ */
+SimdLevel detect_simd_level();
+
+const char* simd_level_name(SimdLevel level);
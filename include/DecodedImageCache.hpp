@@ -0,0 +1,68 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "BaseComparator.hpp"
+#include "Image.hpp"
+
+/*
+ * On-disk cache of decoded images, keyed by a 64-bit hash and the size of the encoded file
+ * (and the decoded bit depth), so renamed or copied references still hit. An entry is a 32-byte
+ * header followed by the raw 8- or 16-bit RGB pixels and is memory-mapped on a hit instead of being decoded.
+ *
+ * The cache is shared between processes: entries are written to a temporary file and renamed,
+ * hits refresh the modification time. The size of the directory is scanned once and then tracked
+ * per insert; when it grows over max_bytes the directory is rescanned (picking up entries of other
+ * processes) and the least recently used entries are removed down to 3/4 of max_bytes. Temporary
+ * files count towards the size and are removed once they're stale, i.e. left behind by a crashed writer.
+ */
+class DecodedImageCache
+{
+public:
+    DecodedImageCache(const std::string& directory, uint64_t max_bytes);
+
+    /* Same contract as BaseComparator::decode_image(), safe to call from several threads */
+    Image load(const ImageView& encoded, ImageMetadata& img_data);
+
+private:
+    std::string entry_path(const ImageView& encoded, int bit_depth) const;
+
+    Image read_entry(const std::string& path, ImageMetadata& img_data) const;
+    /* Returns the size of the written entry, 0 if it couldn't be written */
+    uint64_t write_entry(const std::string& path, const Image& img, const ImageMetadata& img_data) const;
+
+    /* Rescans the directory into m_total_size and evicts if it's over m_max_bytes, m_mutex must be held */
+    void evict();
+
+    std::string m_directory;
+    uint64_t m_max_bytes;
+
+    std::mutex m_mutex;
+    uint64_t m_total_size;
+};
@@ -0,0 +1,85 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "BaseComparator.hpp"
+
+/*
+ * Integer-domain variant of LumaComparator for 8-bit inputs.
+ * Luma is computed exactly in fixed point (see fixed_luma_scale), normalized to 24-bit values
+ * and squared differences are summed exactly in integers, so the MSE doesn't depend on the
+ * summation order. Each normalized luma value differs from the double path by at most 0.5 / unit,
+ * so the MSE differs by at most (2 * RMSE + 1 / unit) / unit, about 2e-6 relative for 1a/1b.
+ */
+class FixedPointLumaComparator final : public BaseComparator
+{
+public:
+	FixedPointLumaComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges);
+	virtual ~FixedPointLumaComparator();
+
+	void compare(const ImageView& ref_img, const ImageView& src_image) override;
+
+	/* Returns MSE value */
+	double get_error() const override;
+
+	bool save() override;
+
+	std::shared_ptr<const PreparedReference> prepare_reference(const ImageView& ref_img) const override;
+	void compare(const PreparedReference& ref, const ImageView& src_image) override;
+
+	/* Full scale of the normalized luma */
+	static constexpr uint32_t unit = (1u << 24) - 1;
+
+private:
+	/* Reference luma normalized to [0, unit] */
+	struct Reference final : PreparedReference
+	{
+		std::vector<uint32_t> luma;
+	};
+
+	/* Per-tile partial results of the error pass */
+	struct TileError
+	{
+		uint64_t sum     = 0;
+		uint64_t min_err = std::numeric_limits<uint64_t>::max();
+		uint64_t max_err = 0;
+	};
+
+	void reduce_tile_errors(const std::vector<TileError>& tile_errors, size_t num_pixels);
+
+	double m_mse;
+
+	/* Per-pixel squared error, allocated up front by the constructor */
+	std::vector<float> m_mse_image;
+
+	/* Range of m_mse_image, the diff image is normalized from it */
+	float m_min_error;
+	float m_max_error;
+};
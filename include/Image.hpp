@@ -0,0 +1,95 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/*
+ * Non-owning view of interleaved pixel data, this is what the comparators read from.
+ * Channels are 8-bit, or native-endian 16-bit for a bit depth of 16.
+ */
+class ImageView
+{
+public:
+    ImageView() = default;
+    ImageView(const uint8_t* data, size_t size, int bit_depth = 8) : m_data(data), m_size(size), m_bit_depth(bit_depth) {}
+    ImageView(const std::vector<uint8_t>& img) : m_data(img.data()), m_size(img.size()) {}
+
+    const uint8_t* data() const { return m_data; }
+
+    /* Channels of 16-bit images */
+    const uint16_t* data16() const { return reinterpret_cast<const uint16_t*>(m_data); }
+
+    int bit_depth() const { return m_bit_depth; }
+    size_t bytes_per_channel() const { return m_bit_depth > 8 ? 2 : 1; }
+
+    /* Size in bytes */
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const uint8_t& operator[](size_t i) const { return m_data[i]; }
+
+    const uint8_t* begin() const { return m_data; }
+    const uint8_t* end() const { return m_data + m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    int m_bit_depth = 8;
+};
+
+/*
+ * Owns pixel data allocated by whoever produced it (e.g. stbi_image_free for decoded images),
+ * so decoder output can be used in place instead of being copied.
+ */
+class Image
+{
+public:
+    using Deleter = std::function<void(uint8_t*)>;
+
+    Image() = default;
+    Image(uint8_t* data, size_t size, Deleter deleter, int bit_depth = 8) : m_data(data, std::move(deleter)), m_size(size), m_bit_depth(bit_depth) {}
+
+    const uint8_t* data() const { return m_data.get(); }
+    uint8_t* data() { return m_data.get(); }
+
+    /* Size in bytes */
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    int bit_depth() const { return m_bit_depth; }
+
+    ImageView view() const { return ImageView(m_data.get(), m_size, m_bit_depth); }
+    operator ImageView() const { return view(); }
+
+private:
+    std::unique_ptr<uint8_t, Deleter> m_data;
+    size_t m_size = 0;
+    int m_bit_depth = 8;
+};
@@ -0,0 +1,168 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+#include <tinycolormap.hpp>
+
+#include "BaseComparator.hpp"
+#include "DecodedImageCache.hpp"
+#include "Image.hpp"
+#include "ImageWriters.hpp"
+#include "LabComparator.hpp"
+#include "MappedFile.hpp"
+#include "PngWriter.hpp"
+
+/* Options shared by every comparison of a run */
+struct ComparisonSettings
+{
+    std::string mode      = "Luma";
+    std::string precision = "double";
+
+    tinycolormap::ColormapType colormap_type = tinycolormap::ColormapType::Hot;
+    int interpolation_ranges = -1;
+
+    PaletteCacheMode palette_cache_mode = PaletteCacheMode::Auto;
+    OutputFormat output_format = OutputFormat::Png;
+    PngSpeed png_speed = PngSpeed::Fast;
+
+    bool skip_identical_output = false;
+    bool print_metric_to_file  = false;
+
+    /* Reference images are decoded through this cache when it isn't null, it may be shared between threads */
+    DecodedImageCache* ref_cache = nullptr;
+};
+
+struct ComparisonResult
+{
+    bool ok = false;
+
+    /* Set when ok is false */
+    std::string error_message;
+
+    /* MSE in Luma mode, mean delta E*ab in Lab mode */
+    double error = 0.0;
+
+    bool identical = false;
+    bool saved     = false;
+
+    int width     = 0;
+    int height    = 0;
+    int bit_depth = 8;
+};
+
+/* Whether name is a --precision value: float, double or fixed (Luma mode only) */
+bool is_precision_name(const std::string& name);
+
+/* Parses a colormap name such as Hot or Viridis, unknown names fall back to Hot */
+tinycolormap::ColormapType colormap_type_from_name(const std::string& name);
+
+/*
+ * A reference image decoded and converted once (see BaseComparator::prepare_reference), kept in memory
+ * so that any number of sources can be compared against it, from several threads at once
+ */
+class SharedReference
+{
+public:
+    /*
+     * Takes over the file, it is kept for the identical-file check. bit_depth is the depth every source is
+     * compared at, at least the file's own. Returns null and sets error when the reference can't be used.
+     */
+    static std::shared_ptr<const SharedReference> create(const std::string& filename, MappedFile file, int bit_depth, const ComparisonSettings& settings,
+                                                         std::string& error);
+
+    const std::string&       filename() const { return m_filename; }
+    const MappedFile&        file()     const { return m_file; }
+    const ImageMetadata&     metadata() const { return m_metadata; }
+    const PreparedReference& prepared() const { return *m_prepared; }
+
+private:
+    SharedReference(const std::string& filename, MappedFile file, const ImageMetadata& metadata, std::shared_ptr<const PreparedReference> prepared);
+
+    std::string m_filename;
+    MappedFile m_file;
+    ImageMetadata m_metadata;
+    std::shared_ptr<const PreparedReference> m_prepared;
+};
+
+/*
+ * One comparison split into its three steps, so that they can run on different threads one after
+ * another: decode() (preflight, identical-file check, decoding), compare() and save() (diff image,
+ * metric files). A step returns false once the comparison failed, result() tells why.
+ * Progress and metrics are printed to log unless it is null.
+ */
+class ImageComparison
+{
+public:
+    /* out_filename has no extension, "-" writes to stdout. The file names are only used in messages. */
+    ImageComparison(const std::string& ref_filename, const std::string& src_filename, const std::string& out_filename, const ComparisonSettings& settings,
+                    std::ostream* log = nullptr);
+
+    /*
+     * Compares a source with a shared reference, only the source is decoded and converted. The mode and
+     * precision of settings must be the ones the reference was created with.
+     */
+    ImageComparison(std::shared_ptr<const SharedReference> reference, const std::string& src_filename, const std::string& out_filename,
+                    const ComparisonSettings& settings, std::ostream* log = nullptr);
+
+    /* The files are only read during this call. decode_concurrently decodes ref and src on two threads. */
+    bool decode(const MappedFile& ref_file, const MappedFile& src_file, bool decode_concurrently);
+
+    /* decode() for comparisons with a shared reference */
+    bool decode(const MappedFile& src_file);
+
+    /* Releases the decoded images when done */
+    bool compare();
+
+    bool save();
+
+    const ComparisonResult& result() const { return m_result; }
+
+private:
+    bool fail(const std::string& message);
+
+    std::string m_ref_filename;
+    std::string m_src_filename;
+    std::string m_out_filename;
+    ComparisonSettings m_settings;
+    std::ostream* m_log;
+
+    /* Set when comparing with a shared reference, m_ref_image stays empty then */
+    std::shared_ptr<const SharedReference> m_reference;
+
+    std::shared_ptr<BaseComparator> m_comparator;
+    Image m_ref_image;
+    Image m_src_image;
+
+    ComparisonResult m_result;
+};
+
+/* Runs all steps of one comparison, safe to call from several threads at once */
+ComparisonResult compare_images(const std::string& ref_filename, const MappedFile& ref_file,
+                                const std::string& src_filename, const MappedFile& src_file,
+                                const std::string& out_filename, const ComparisonSettings& settings, std::ostream* log = nullptr);
@@ -0,0 +1,65 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+ * Output formats of the diff image. Png, Ppm and Qoi hold the colormapped, normalized error,
+ * Pfm and Raw hold the unnormalized per-pixel error as 32-bit floats for further analysis.
+ */
+enum class OutputFormat
+{
+    Png,
+    Ppm,
+    Qoi,
+    Pfm,
+    Raw
+};
+
+/* Parses png, ppm, qoi, pfm or raw, returns false for anything else */
+bool output_format_from_name(const std::string& name, OutputFormat& format);
+
+/* If filename ends with a known extension it is stripped and the matching format is returned */
+bool split_output_extension(std::string& filename, OutputFormat& format);
+
+/* Extension including the dot, e.g. ".png" */
+const char* output_format_extension(OutputFormat format);
+
+bool is_float_output_format(OutputFormat format);
+
+/* Binary PPM (P6) of an 8-bit RGB image */
+bool write_ppm(FILE* file, unsigned width, unsigned height, const uint8_t* rgb);
+
+/* QOI (https://qoiformat.org) of an 8-bit RGB image */
+bool write_qoi(FILE* file, unsigned width, unsigned height, const uint8_t* rgb);
+
+/* Grayscale PFM ("Pf"), little-endian, rows stored bottom to top as the format requires */
+bool write_pfm(FILE* file, unsigned width, unsigned height, const float* values);
+
+/* Headerless little-endian float32 values, rows stored top to bottom */
+bool write_raw_float(FILE* file, unsigned width, unsigned height, const float* values);
@@ -0,0 +1,72 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+/* Value of a flat JSON object, numbers and literals keep their source text */
+struct JsonValue
+{
+    enum class Type
+    {
+        String,
+        Number,
+        Bool,
+        Null
+    };
+
+    Type type = Type::Null;
+    std::string text;
+};
+
+/*
+ * Minimal parser for one JSON Lines record: an object whose values are strings, numbers, true, false
+ * or null. Nested objects and arrays aren't supported. Returns false and sets error on malformed input.
+ */
+bool parse_json_object(const std::string& text, std::map<std::string, JsonValue>& fields, std::string& error);
+
+/* Builds a single-line JSON object, keys are written in insertion order */
+class JsonObjectWriter
+{
+public:
+    JsonObjectWriter& add_string(const std::string& key, const std::string& value);
+    JsonObjectWriter& add_integer(const std::string& key, int64_t value);
+    JsonObjectWriter& add_bool(const std::string& key, bool value);
+
+    /* Written with enough digits to round-trip, non-finite values become null */
+    JsonObjectWriter& add_number(const std::string& key, double value);
+
+    std::string str() const { return "{" + m_body + "}"; }
+
+private:
+    void add_key(const std::string& key);
+
+    std::string m_body;
+};
+
+/* Returns value as a quoted JSON string */
+std::string json_quote(const std::string& value);
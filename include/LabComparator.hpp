@@ -24,19 +24,77 @@ SOFTWARE.
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+
 #include "BaseComparator.hpp"
+#include "LabPaletteCache.hpp"
+
+/* Whether RGB -> L*a*b* conversions go through a LabPaletteCache. Auto samples the images first. */
+enum class PaletteCacheMode
+{
+	Auto,
+	On,
+	Off
+};
 
+/* T is the per-pixel scalar type (float or double), the mean delta E is always accumulated in double */
+template<typename T>
 class LabComparator final : public BaseComparator
 {
 public:
-	LabComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges);
+	LabComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges,
+	              PaletteCacheMode palette_cache_mode = PaletteCacheMode::Auto);
 	virtual ~LabComparator();
 
-	void compare(const std::vector<uint8_t>& ref_img, const std::vector<uint8_t>& src_image) override;
+	void compare(const ImageView& ref_img, const ImageView& src_image) override;
 
 	/* Returns Delta E value */
 	double get_error() const override;
 
+	bool save() override;
+
+	std::shared_ptr<const PreparedReference> prepare_reference(const ImageView& ref_img) const override;
+	void compare(const PreparedReference& ref, const ImageView& src_image) override;
+
+	/* Reports palette cache usage and hit rate */
+	void print_stats(std::ostream& out) const override;
+
 private:
+	/* Reference converted to interleaved L*a*b*, with the color sample Auto palette cache mode decides on */
+	struct Reference final : PreparedReference
+	{
+		std::vector<T> lab;
+
+		/* Empty for 16-bit references */
+		std::vector<uint32_t> palette_sample;
+	};
+
+	/*
+	 * Computes delta E of every pixel, ref_to_lab(i, lab, pixel_to_lab) writes the reference's L*a*b* pixel i
+	 * and may use pixel_to_lab(img, i, lab), the conversion picked for this comparison
+	 */
+	template<typename RefToLab>
+	void compare_pixels(const ImageView& src_image, RefToLab&& ref_to_lab);
+
+	std::unique_ptr<LabPaletteCache<T>> acquire_cache();
+	void release_cache(std::unique_ptr<LabPaletteCache<T>> cache);
+
 	double m_delta_e;
+
+	/* Per-pixel delta E, allocated up front by the constructor */
+	std::vector<T> m_delta_e_image;
+
+	/* Range of m_delta_e_image, the diff image is normalized from it */
+	T m_min_error;
+	T m_max_error;
+
+	PaletteCacheMode m_palette_cache_mode;
+	bool             m_palette_cache_used;
+	size_t           m_palette_cache_hits;
+	size_t           m_palette_cache_lookups;
+
+	/* Idle caches, each tile task borrows one so workers never share a cache */
+	std::vector<std::unique_ptr<LabPaletteCache<T>>> m_caches;
+	std::mutex                                       m_caches_mutex;
 };
\ No newline at end of file
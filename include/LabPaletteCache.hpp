@@ -0,0 +1,168 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "ColorConversion.hpp"
+#include "Image.hpp"
+
+/* 
+ * Memoizing RGB -> L*a*b* converter for images with few distinct colors, e.g. GUI screenshots.
+ * Colors are packed into RGB24 keys of an open addressing table with linear probing, so every
+ * distinct color is converted once. When the table is 3/4 full new colors are converted without
+ * being stored. Results are identical to color::rgb_to_lab. Not thread-safe, use one per worker.
+ */
+template<typename T>
+class LabPaletteCache
+{
+public:
+    static constexpr unsigned capacity_log2 = 16;
+    static constexpr size_t   capacity      = size_t(1) << capacity_log2;
+
+    LabPaletteCache()
+        : m_keys  (capacity, empty_key),
+          m_values(3 * capacity),
+          m_size  (0),
+          m_hits  (0),
+          m_misses(0)
+    {
+    }
+
+    void convert(const uint8_t* rgb, T* lab)
+    {
+        const uint32_t key = uint32_t(rgb[0]) | (uint32_t(rgb[1]) << 8) | (uint32_t(rgb[2]) << 16);
+
+        for (size_t slot = hash(key);; slot = (slot + 1) & (capacity - 1))
+        {
+            if (m_keys[slot] == key)
+            {
+                ++m_hits;
+                std::copy_n(&m_values[3 * slot], 3, lab);
+                return;
+            }
+
+            if (m_keys[slot] == empty_key)
+            {
+                ++m_misses;
+                color::rgb_to_lab(rgb, lab);
+
+                if (m_size < capacity / 4 * 3)
+                {
+                    m_keys[slot] = key;
+                    std::copy_n(lab, 3, &m_values[3 * slot]);
+                    ++m_size;
+                }
+
+                return;
+            }
+        }
+    }
+
+    size_t hits()   const { return m_hits; }
+    size_t misses() const { return m_misses; }
+
+    /* 
+     * Counts distinct colors in an evenly strided sample of both images.
+     * The cache pays off when the sample repeats colors a lot: at most one distinct color per 16 samples.
+     */
+    static bool is_low_palette(const ImageView& ref_img, const ImageView& src_image)
+    {
+        if (ref_img.bit_depth() != 8 || src_image.bit_depth() != 8)
+        {
+            return false;
+        }
+
+        return is_low_palette(sample_colors(ref_img), sample_colors(src_image));
+    }
+
+    /* Same decision from samples taken by sample_colors(), e.g. one kept with a prepared reference */
+    static bool is_low_palette(const std::vector<uint32_t>& ref_sample, const std::vector<uint32_t>& src_sample)
+    {
+        std::vector<uint32_t> seen(capacity, empty_key);
+        size_t num_colors = 0;
+
+        for (const auto* sample : { &ref_sample, &src_sample })
+        {
+            for (const uint32_t key : *sample)
+            {
+                size_t slot = hash(key);
+                while (seen[slot] != empty_key && seen[slot] != key)
+                {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+
+                if (seen[slot] == empty_key)
+                {
+                    seen[slot] = key;
+
+                    /* Far past the threshold already, also keeps the table from filling up */
+                    if (++num_colors > capacity / 4)
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        return num_colors * 16 <= ref_sample.size() + src_sample.size();
+    }
+
+    /* RGB24 keys of an evenly strided sample of an 8-bit image, at most about 32768 of them */
+    static std::vector<uint32_t> sample_colors(const ImageView& img)
+    {
+        constexpr size_t max_samples = 32768;
+
+        const size_t num_pixels = img.size() / 3;
+        const size_t stride     = std::max<size_t>(1, num_pixels / max_samples);
+
+        std::vector<uint32_t> sample;
+        sample.reserve(num_pixels / stride + 1);
+
+        for (size_t i = 0; i < num_pixels; i += stride)
+        {
+            const uint8_t* rgb = &img[3 * i];
+            sample.push_back(uint32_t(rgb[0]) | (uint32_t(rgb[1]) << 8) | (uint32_t(rgb[2]) << 16));
+        }
+
+        return sample;
+    }
+
+private:
+    static constexpr uint32_t empty_key = 0xffffffffu;
+
+    static size_t hash(uint32_t key)
+    {
+        return (key * 0x9e3779b1u) >> (32 - capacity_log2);
+    }
+
+    std::vector<uint32_t> m_keys;
+    std::vector<T>        m_values;
+    size_t                m_size;
+    size_t                m_hits;
+    size_t                m_misses;
+};
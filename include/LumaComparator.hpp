@@ -24,19 +24,54 @@ SOFTWARE.
 
 #pragma once
 
+#include <limits>
+#include <memory>
+#include <vector>
+
 #include "BaseComparator.hpp"
 
+/* T is the per-pixel scalar type (float or double), the MSE is always accumulated in double */
+template<typename T>
 class LumaComparator final : public BaseComparator
 {
 public:
 	LumaComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges);
 	virtual ~LumaComparator();
 
-	void compare(const std::vector<uint8_t>& ref_img, const std::vector<uint8_t>& src_image) override;
+	void compare(const ImageView& ref_img, const ImageView& src_image) override;
 	
 	/* Returns MSE value */
 	double get_error() const override;
 
+	bool save() override;
+
+	std::shared_ptr<const PreparedReference> prepare_reference(const ImageView& ref_img) const override;
+	void compare(const PreparedReference& ref, const ImageView& src_image) override;
+
 private:
+	/* Reference luma normalized to [0, 1] */
+	struct Reference final : PreparedReference
+	{
+		std::vector<T> luma;
+	};
+
+	/* Per-tile partial results of the error pass */
+	struct TileError
+	{
+		double sum     = 0.0;
+		T      min_err = std::numeric_limits<T>::max();
+		T      max_err = std::numeric_limits<T>::lowest();
+	};
+
+	/* Combines the tiles in tile order, so the result doesn't depend on scheduling */
+	void reduce_tile_errors(const std::vector<TileError>& tile_errors, size_t num_pixels);
+
 	double m_mse;
+
+	/* Per-pixel squared error, allocated up front by the constructor */
+	std::vector<T> m_mse_image;
+
+	/* Range of m_mse_image, the diff image is normalized from it */
+	T m_min_error;
+	T m_max_error;
 };
\ No newline at end of file
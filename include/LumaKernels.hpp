@@ -0,0 +1,120 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "CpuFeatures.hpp"
+#include "Image.hpp"
+
+/* 
+ * Rec. 709 luma kernels: luma[i] = (0.2126 * R + 0.7152 * G + 0.0722 * B) / 255 for interleaved 8-bit RGB.
+ *
+ * The scalar kernel is the reference. The vector kernels fold the 1/255 scale into the weights and
+ * accumulate with FMA (SSE4.1 uses mul + add), so they may differ from it in the last bits:
+ * for every 8-bit RGB triple the absolute difference is below 4e-16 (under two ulp of 1.0).
+ * The float kernels are accurate to within 1.2e-7, so they process twice as many pixels per vector.
+ *
+ * The uint32_t kernels compute exact fixed-point luma 2126 * R + 7152 * G + 722 * B, i.e. the value
+ * above scaled by fixed_luma_scale. All levels produce identical results.
+ *
+ * 16-bit input uses luma_kernel16 with the scale 1/65535, a plain loop that the compiler vectorizes.
+ * For 8-bit values widened to 16 bits (v * 257) it matches the scalar 8-bit kernel exactly.
+ */
+template<typename T>
+using LumaKernel = void (*)(const uint8_t* rgb, T* luma, size_t num_pixels);
+
+void luma_kernel_scalar(const uint8_t* rgb, double* luma, size_t num_pixels);
+void luma_kernel_sse41 (const uint8_t* rgb, double* luma, size_t num_pixels);
+void luma_kernel_avx2  (const uint8_t* rgb, double* luma, size_t num_pixels);
+void luma_kernel_avx512(const uint8_t* rgb, double* luma, size_t num_pixels);
+
+void luma_kernel_scalar(const uint8_t* rgb, float* luma, size_t num_pixels);
+void luma_kernel_sse41 (const uint8_t* rgb, float* luma, size_t num_pixels);
+void luma_kernel_avx2  (const uint8_t* rgb, float* luma, size_t num_pixels);
+void luma_kernel_avx512(const uint8_t* rgb, float* luma, size_t num_pixels);
+
+constexpr uint32_t fixed_luma_scale = 10000 * 255;
+
+void luma_kernel_scalar(const uint8_t* rgb, uint32_t* luma, size_t num_pixels);
+void luma_kernel_sse41 (const uint8_t* rgb, uint32_t* luma, size_t num_pixels);
+void luma_kernel_avx2  (const uint8_t* rgb, uint32_t* luma, size_t num_pixels);
+void luma_kernel_avx512(const uint8_t* rgb, uint32_t* luma, size_t num_pixels);
+
+void luma_kernel16(const uint16_t* rgb, double* luma, size_t num_pixels);
+void luma_kernel16(const uint16_t* rgb, float* luma, size_t num_pixels);
+
+/* Returns the fastest kernel for the running CPU, chosen on the first call */
+template<typename T>
+LumaKernel<T> select_luma_kernel();
+
+/* Luma of count pixels of img starting at pixel offset, kernel is used for 8-bit images */
+template<typename T>
+inline void compute_luma(const ImageView& img, LumaKernel<T> kernel, size_t offset, T* luma, size_t count)
+{
+    if (img.bit_depth() > 8)
+    {
+        luma_kernel16(img.data16() + 3 * offset, luma, count);
+    }
+    else
+    {
+        kernel(img.data() + 3 * offset, luma, count);
+    }
+}
+
+/* 
+ * Drives a vector kernel that converts BlockPixels pixels per call and may read up to 4 bytes past them.
+ * The last pixels are copied into a zero-padded buffer instead of falling back to scalar code, so every
+ * pixel goes through the same arithmetic no matter how the caller splits the image into chunks.
+ */
+template<size_t BlockPixels, typename T, typename Block>
+inline void run_luma_blocks(const uint8_t* rgb, T* luma, size_t num_pixels, Block block)
+{
+    size_t i = 0;
+
+    for (; i + BlockPixels + 2 <= num_pixels; i += BlockPixels)
+    {
+        block(rgb + 3 * i, luma + i);
+    }
+
+    const size_t rest = num_pixels - i;
+
+    if (rest > 0)
+    {
+        uint8_t padded[3 * 2 * BlockPixels + 16] = {};
+        T       out[2 * BlockPixels];
+
+        std::memcpy(padded, rgb + 3 * i, 3 * rest);
+
+        for (size_t j = 0; j < rest; j += BlockPixels)
+        {
+            block(padded + 3 * j, out + j);
+        }
+
+        std::memcpy(luma + i, out, rest * sizeof(T));
+    }
+}
@@ -0,0 +1,73 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Read-only view of a whole file. The file is memory-mapped (mmap with a sequential access hint on POSIX,
+ * a file mapping on Windows) so decoders read straight from the page cache. When mapping isn't possible
+ * the contents are read into an owned buffer instead.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /* False if the file couldn't be opened or read */
+    bool is_open() const { return m_open; }
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    /* Reads size bytes (or everything up to EOF for SIZE_MAX) from a stream such as stdin, is_open() is false on short reads */
+    static MappedFile read_stream(FILE* stream, size_t size = SIZE_MAX);
+
+    /* Byte-wise comparison, the blocks of large files are compared in parallel */
+    static bool same_contents(const MappedFile& a, const MappedFile& b);
+
+private:
+    void release();
+    bool read_into_buffer(const std::string& filename);
+    bool read_into_buffer(FILE* stream, size_t limit);
+
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_open = false;
+    bool m_mapped = false;
+    std::vector<uint8_t> m_buffer;
+};
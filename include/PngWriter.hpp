@@ -0,0 +1,52 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+ * Trade-off between PNG encoding time and file size:
+ *   Store - uncompressed deflate blocks, no filtering
+ *   Rle   - Sub filter and run-length matches only
+ *   Fast  - Sub/Up filter per row and single-probe LZ77
+ *   Best  - stb_image_write (tries every filter per row, single-threaded)
+ * Store, Rle and Fast deflate row chunks in parallel, the chunks are joined with empty stored blocks
+ * (a zlib sync flush), so the result is one regular zlib stream.
+ */
+enum class PngSpeed
+{
+    Store,
+    Rle,
+    Fast,
+    Best
+};
+
+/* Parses store, rle, fast or best, anything else falls back to Fast */
+PngSpeed png_speed_from_name(const std::string& name);
+
+/* Writes an 8-bit RGB image, returns false on I/O errors */
+bool write_png(FILE* file, unsigned width, unsigned height, const uint8_t* rgb, PngSpeed speed);
@@ -0,0 +1,90 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* 
+ * Fixed-size work-stealing pool of worker threads running data-parallel loops.
+ * A loop starts as one range of task indices. Whoever runs a range keeps splitting it in half, queues
+ * the upper half on its own deque and carries on with the lower one, so it walks its tasks in order
+ * while idle workers steal the oldest (largest) halves from the other end. Loops started outside the
+ * pool are queued on a shared deque.
+ * Several threads may call parallel_for() at the same time and calls may be nested;
+ * the calling thread always takes part in its own loop, so progress never depends on free workers.
+ */
+class ThreadPool
+{
+public:
+    /* num_threads counts the calling thread too, so ThreadPool(1) starts no workers */
+    explicit ThreadPool(unsigned num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const;
+
+    /* Calls task(i) for every i in [0, num_tasks) and returns when all calls have finished */
+    void parallel_for(size_t num_tasks, const std::function<void(size_t)>& task);
+
+    /* Process-wide pool used by the comparators. 0 threads means one per hardware thread. */
+    static void set_global_threads(unsigned num_threads);
+    static ThreadPool& global();
+
+private:
+    struct Job;
+    struct Range;
+    struct WorkQueue;
+
+    void worker_loop(size_t index);
+
+    /* Own deque first (newest range), then the shared deque and the other workers (oldest range) */
+    bool take_range(size_t self, Range& range);
+
+    /* Same, limited to the ranges of one loop */
+    bool take_job_range(const Job& job, size_t self, Range& range);
+
+    void push_range(size_t self, Range range);
+    void execute(Range range, size_t self);
+
+    /* One deque per worker, the last one is shared by threads outside the pool */
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread>                m_workers;
+
+    /* Ranges in all deques, incremented before a range is pushed; idle workers sleep while it is 0 */
+    std::atomic<size_t>                     m_queued;
+    std::atomic<unsigned>                   m_sleepers;
+    std::mutex                              m_mutex;
+    std::condition_variable                 m_cv;
+    bool                                    m_stop;
+};
@@ -26,162 +26,279 @@ SOFTWARE.
 
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <limits>
 
-#include <stb_image_write.h>
+#include "ColorConversion.hpp"
+#include "LumaKernels.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
 
 BaseComparator::BaseComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges)
     : m_colormap_type       (colormap_type),
-      m_out_filename        (out_filename + ".png"),
+      m_out_filename        (out_filename),
       m_width               (width),
       m_height              (height),
-      m_interpolation_ranges(interpolation_ranges) {}
+      m_interpolation_ranges(interpolation_ranges),
+      m_colormap_lut        (ColormapLut::get(colormap_type, interpolation_ranges)) {}
 
 BaseComparator::~BaseComparator() {}
 
-std::vector<uint8_t> BaseComparator::load_image(const std::string& filename, ImageMetadata& img_data)
+void BaseComparator::print_stats(std::ostream& /*out*/) const {}
+
+bool BaseComparator::save_identical()
 {
-    std::vector<uint8_t> img;
-    int nr_channels_in_file;
+    return save_diff_image(std::vector<float>(size_t(m_width) * m_height, 0.0f), 0.0f, 0.0f);
+}
 
-    img_data.nr_channels = 3;
-    auto* data = stbi_load(filename.c_str(), &img_data.width, &img_data.height, &nr_channels_in_file, img_data.nr_channels);
+bool BaseComparator::read_metadata(const std::string& filename, ImageMetadata& img_data)
+{
+    /* Only the pages holding the header are ever touched */
+    MappedFile file(filename);
+
+    return file.is_open() && read_metadata(ImageView(file.data(), file.size()), img_data);
+}
 
-    if (data)
+bool BaseComparator::read_metadata(const ImageView& encoded, ImageMetadata& img_data)
+{
+    if (encoded.empty() || encoded.size() > size_t(std::numeric_limits<int>::max()))
     {
-        img = std::vector<uint8_t>(data, data + img_data.width * img_data.height * img_data.nr_channels);
-        stbi_image_free(data);
+        return false;
     }
 
-    return img;
+    const int size = int(encoded.size());
+
+    if (!stbi_info_from_memory(encoded.data(), size, &img_data.width, &img_data.height, &img_data.nr_channels_in_file))
+    {
+        return false;
+    }
+
+    img_data.nr_channels = 3;
+    img_data.bit_depth   = stbi_is_16_bit_from_memory(encoded.data(), size) ? 16 : 8;
+
+    return true;
 }
 
-std::vector<double> BaseComparator::luma(const std::vector<uint8_t>& img)
+Image BaseComparator::decode_image(const ImageView& encoded, ImageMetadata& img_data)
 {
-    const unsigned num_pixels = img.size() / 3;
+    Image img;
 
-    std::vector<double> luma(num_pixels);
+    img_data.nr_channels = 3;
 
-    for (unsigned i = 0; i < num_pixels; ++i)
+    if (encoded.size() > size_t(std::numeric_limits<int>::max()))
     {
-        /* Conver to [0, 1] range */
-        double r = img[3 * i + 0] / 255.0;
-        double g = img[3 * i + 1] / 255.0;
-        double b = img[3 * i + 2] / 255.0;
+        return img;
+    }
+
+    const size_t num_channels = size_t(img_data.nr_channels);
 
-        /* Calculate luminance */
-        luma[i] = r * 0.2126 + g * 0.7152 + b * 0.0722;
+    /* The decoder's buffer is used directly and released with stbi_image_free() */
+    if (img_data.bit_depth > 8)
+    {
+        auto* data = stbi_load_16_from_memory(encoded.data(), int(encoded.size()), &img_data.width, &img_data.height, &img_data.nr_channels_in_file, img_data.nr_channels);
+
+        if (data)
+        {
+            img = Image(reinterpret_cast<uint8_t*>(data), size_t(img_data.width) * img_data.height * num_channels * 2, [](uint8_t* p) { stbi_image_free(p); }, 16);
+        }
     }
+    else
+    {
+        auto* data = stbi_load_from_memory(encoded.data(), int(encoded.size()), &img_data.width, &img_data.height, &img_data.nr_channels_in_file, img_data.nr_channels);
 
-    return luma;
+        if (data)
+        {
+            img = Image(data, size_t(img_data.width) * img_data.height * num_channels, [](uint8_t* p) { stbi_image_free(p); });
+        }
+    }
+
+    return img;
 }
 
-std::vector<double> BaseComparator::normalize_image_linear(const std::vector<double>& img, double new_min, double new_max)
+template<typename T>
+std::vector<T> BaseComparator::luma(const ImageView& img)
 {
-    const auto [min, max] = std::minmax_element(std::begin(img), std::end(img));
+    const size_t num_pixels = img.size() / (3 * img.bytes_per_channel());
 
-    double denom = (*max - *min);
-    if (denom <= 0.0)
+    std::vector<T> luma(num_pixels);
+
+    /* Dispatches to the SSE4.1/AVX2/AVX-512 kernel picked for this CPU */
+    const auto luma_kernel = select_luma_kernel<T>();
+
+    ThreadPool::global().parallel_for(num_tiles(num_pixels), [&](size_t tile)
     {
-        denom = 1.0;
+        const size_t begin = tile * tile_size;
+        compute_luma(img, luma_kernel, begin, &luma[begin], std::min(tile_size, num_pixels - begin));
+    });
+
+    return luma;
+}
+
+template<typename T>
+std::pair<T, T> BaseComparator::image_min_max(const std::vector<T>& img)
+{
+    if (img.empty())
+    {
+        return { T(0), T(0) };
     }
 
-    double ratio = (new_max - new_min) / denom;
+    std::vector<std::pair<T, T>> tile_bounds(num_tiles(img.size()));
+
+    ThreadPool::global().parallel_for(tile_bounds.size(), [&](size_t tile)
+    {
+        const size_t begin = tile * tile_size;
+        const size_t end   = std::min(img.size(), begin + tile_size);
+
+        /* Plain compare-and-select loops so that the compiler emits packed min/max */
+        T min = img[begin];
+        T max = img[begin];
+
+        for (size_t i = begin + 1; i < end; ++i)
+        {
+            min = img[i] < min ? img[i] : min;
+            max = img[i] > max ? img[i] : max;
+        }
+
+        tile_bounds[tile] = { min, max };
+    });
 
-    std::vector<double> norm_img(img.size());
+    auto bounds = tile_bounds[0];
 
-    for (unsigned int i = 0; i < img.size(); ++i)
+    for (const auto& tile_bound : tile_bounds)
     {
-        norm_img[i] = (img[i] - *min) * ratio + new_min;
+        bounds.first  = std::min(bounds.first,  tile_bound.first);
+        bounds.second = std::max(bounds.second, tile_bound.second);
     }
 
-    return norm_img;
+    return bounds;
 }
 
-std::vector<double> BaseComparator::rgb_2_lab(const std::vector<uint8_t>& img)
+template<typename T>
+std::vector<T> BaseComparator::rgb_2_lab(const ImageView& img)
 {
-    std::vector<double> lab(img.size());
-    std::array<double, 3> rgb;
-    std::array<double, 3> xyz;
+    const size_t num_pixels = img.size() / (3 * img.bytes_per_channel());
 
-    double ref_x = 95.047;
-    double ref_y = 100.000;
-    double ref_z = 108.883;
+    std::vector<T> lab(3 * num_pixels);
 
-    auto num_pixels = lab.size() / 3;
+    const T* table16 = img.bit_depth() > 8 ? color::srgb16_to_linear_table<T>() : nullptr;
 
-    for (unsigned i = 0; i < num_pixels; ++i)
+    ThreadPool::global().parallel_for(num_tiles(num_pixels), [&](size_t tile)
     {
-        /* Conver to [0, 1] range */
-        rgb[0] = img[3 * i + 0] / 255.0;
-        rgb[1] = img[3 * i + 1] / 255.0;
-        rgb[2] = img[3 * i + 2] / 255.0;
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
 
-        /* Convert to XYZ with respect to D65/2 standard illuminant. */
-        for (auto& comp : rgb)
+        for (size_t i = tile * tile_size; i < end; ++i)
         {
-            if (comp > 0.04045)
+            if (table16)
             {
-                comp = std::pow((comp + 0.055) / 1.055, 2.4);
+                color::rgb_to_lab(img.data16() + 3 * i, &lab[3 * i], table16);
             }
             else
             {
-                comp /= 12.92;
+                color::rgb_to_lab(&img[3 * i], &lab[3 * i]);
             }
-
-            comp *= 100.0;
         }
+    });
 
-        xyz[0] = rgb[0] * 0.4124 + rgb[1] * 0.3576 + rgb[2] * 0.1805;
-        xyz[1] = rgb[0] * 0.2126 + rgb[1] * 0.7152 + rgb[2] * 0.0722;
-        xyz[2] = rgb[0] * 0.0193 + rgb[1] * 0.1192 + rgb[2] * 0.9505;
+    return lab;
+}
 
-        /* Convert to L*a*b* with respect to D65/2 standard illuminant. */
-        xyz[0] /= ref_x;
-        xyz[1] /= ref_y;
-        xyz[2] /= ref_z;
+template<typename T>
+bool BaseComparator::save_diff_image(const std::vector<T>& error_img, T min_error, T max_error)
+{
+    /* "-" streams the image to stdout */
+    const bool to_stdout = m_out_filename == "-";
+    const std::string filename = m_out_filename + output_format_extension(m_output_format);
 
-        for (auto& comp : xyz)
-        {
-            if (comp > 0.008856)
-            {
-                comp = std::pow(comp, 1.0 / 3.0);
-            }
-            else
-            {
-                comp = (7.787 * comp) + (16.0 / 116.0);
-            }
-        }
+    FILE* file = to_stdout ? stdout : std::fopen(filename.c_str(), "wb");
 
-        lab[3 * i + 0] = (116.0 * xyz[1]) - 16.0;
-        lab[3 * i + 1] = 500.0 * (xyz[0] - xyz[1]);
-        lab[3 * i + 2] = 200.0 * (xyz[1] - xyz[2]);
+    if (!file)
+    {
+        return false;
     }
 
-    return lab;
-}
+    bool written = false;
 
-void BaseComparator::save_diff_image(const std::vector<double>& error_img)
-{
-    std::vector<uint8_t> diff_image(error_img.size() * 3);
+    auto& pool = ThreadPool::global();
 
-    for (unsigned i = 0; i < error_img.size(); ++i)
+    if (is_float_output_format(m_output_format))
     {
-        // Get Color from colormap
-        tinycolormap::Color color(1.0, 1.0, 1.0);
+        /* Float formats keep the error values as they are */
+        std::vector<float> values(error_img.size());
 
-        if (m_interpolation_ranges <= 0)
+        pool.parallel_for(num_tiles(error_img.size()), [&](size_t tile)
         {
-            color = tinycolormap::GetColor(error_img[i], m_colormap_type);
+            const size_t end = std::min(error_img.size(), (tile + 1) * tile_size);
+
+            for (size_t i = tile * tile_size; i < end; ++i)
+            {
+                values[i] = float(error_img[i]);
+            }
+        });
+
+        if (m_output_format == OutputFormat::Pfm)
+        {
+            written = write_pfm(file, m_width, m_height, values.data());
         }
         else
         {
-            // TODO
+            written = write_raw_float(file, m_width, m_height, values.data());
         }
+    }
+    else
+    {
+        std::vector<uint8_t> diff_image(error_img.size() * 3);
 
-        diff_image[3 * i + 0] = color.ri();
-        diff_image[3 * i + 1] = color.gi();
-        diff_image[3 * i + 2] = color.bi();
+        /* Linear normalization to [0, 1] (https://en.wikipedia.org/wiki/Normalization_(image_processing)), fused with the colormap gather */
+        T denom = max_error - min_error;
+        if (denom <= T(0))
+        {
+            denom = T(1);
+        }
+
+        const T ratio = T(1) / denom;
+
+        /* The table already holds either the interpolated or the banded colormap */
+        const ColormapLut& lut = *m_colormap_lut;
+
+        pool.parallel_for(num_tiles(error_img.size()), [&](size_t tile)
+        {
+            const size_t end = std::min(error_img.size(), (tile + 1) * tile_size);
+
+            for (size_t i = tile * tile_size; i < end; ++i)
+            {
+                lut.lookup((error_img[i] - min_error) * ratio, &diff_image[3 * i]);
+            }
+        });
+
+        switch (m_output_format)
+        {
+            case OutputFormat::Ppm: written = write_ppm(file, m_width, m_height, diff_image.data()); break;
+            case OutputFormat::Qoi: written = write_qoi(file, m_width, m_height, diff_image.data()); break;
+            default:                written = write_png(file, m_width, m_height, diff_image.data(), m_png_speed); break;
+        }
+    }
+
+    /* Buffered data is only written by fflush() or fclose(), so they can fail as well */
+    if (to_stdout)
+    {
+        written = std::fflush(file) == 0 && written;
+    }
+    else
+    {
+        written = std::fclose(file) == 0 && written;
     }
 
-    stbi_write_png(m_out_filename.c_str(), m_width, m_height, 3, diff_image.data(), 0);
+    return written;
 }
+
+template std::vector<float>  BaseComparator::luma<float>(const ImageView& img);
+template std::vector<double> BaseComparator::luma<double>(const ImageView& img);
+
+template std::pair<float, float>   BaseComparator::image_min_max<float>(const std::vector<float>& img);
+template std::pair<double, double> BaseComparator::image_min_max<double>(const std::vector<double>& img);
+
+template std::vector<float>  BaseComparator::rgb_2_lab<float>(const ImageView& img);
+template std::vector<double> BaseComparator::rgb_2_lab<double>(const ImageView& img);
+
+template bool BaseComparator::save_diff_image<float>(const std::vector<float>& error_img, float min_error, float max_error);
+template bool BaseComparator::save_diff_image<double>(const std::vector<double>& error_img, double min_error, double max_error);
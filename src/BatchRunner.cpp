@@ -0,0 +1,641 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "BatchRunner.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.hpp"
+#include "JsonLines.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct ManifestRecord
+    {
+        size_t      line_number;
+        std::string text;
+    };
+
+    /* One pair on its way through the pipeline */
+    struct PairTask
+    {
+        /* Filled in up front with the fields identifying the pair */
+        JsonObjectWriter line;
+
+        std::string ref_filename;
+        std::string src_filename;
+        std::string mode;
+
+        /* Null when the pair was rejected before decoding, line then holds the error */
+        std::unique_ptr<ImageComparison> comparison;
+
+        /* Only the source is read, the comparison has a SharedReference */
+        bool shared_reference = false;
+
+        Clock::time_point start;
+    };
+
+    struct RunStats
+    {
+        size_t       num_pairs  = 0;
+        size_t       num_failed = 0;
+        uint64_t     num_pixels = 0;
+        PipelineJobs jobs;
+        double       seconds    = 0.0;
+    };
+
+    /* Extensions of the formats stb_image decodes */
+    bool is_image_file(const fs::path& path)
+    {
+        static const char* const extensions[] = { ".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif", ".psd", ".hdr", ".pic", ".pnm", ".ppm", ".pgm" };
+
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+
+        return std::find(std::begin(extensions), std::end(extensions), extension) != std::end(extensions);
+    }
+
+    /*
+     * Lists the images below both roots by relative path ('/' separated, sorted). Both trees are walked
+     * together one directory level at a time, the directories of a level are listed in parallel.
+     * Symbolic links to directories aren't followed, so cycles can't occur.
+     */
+    bool list_images(const fs::path (&roots)[2], std::vector<std::string> (&files)[2], std::string& error)
+    {
+        struct Directory
+        {
+            int         tree;
+            fs::path    path;
+            std::string relative;
+        };
+
+        std::vector<Directory> level = { { 0, roots[0], "" }, { 1, roots[1], "" } };
+
+        while (!level.empty())
+        {
+            std::vector<std::vector<Directory>>   subdirectories(level.size());
+            std::vector<std::vector<std::string>> images(level.size());
+            std::vector<std::error_code>          errors(level.size());
+
+            ThreadPool::global().parallel_for(level.size(), [&](size_t i)
+            {
+                const Directory& directory = level[i];
+                std::error_code& list_error = errors[i];
+
+                for (fs::directory_iterator it(directory.path, list_error), end; !list_error && it != end; it.increment(list_error))
+                {
+                    std::error_code entry_error;
+                    const std::string name = it->path().filename().string();
+                    const std::string relative = directory.relative.empty() ? name : directory.relative + "/" + name;
+
+                    if (it->is_directory(entry_error) && !it->is_symlink(entry_error))
+                    {
+                        subdirectories[i].push_back({ directory.tree, it->path(), relative });
+                    }
+                    else if (it->is_regular_file(entry_error) && is_image_file(it->path()))
+                    {
+                        images[i].push_back(relative);
+                    }
+                }
+            });
+
+            std::vector<Directory> next_level;
+
+            for (size_t i = 0; i < level.size(); ++i)
+            {
+                if (errors[i])
+                {
+                    error = "Couldn't list " + level[i].path.string() + ": " + errors[i].message();
+                    return false;
+                }
+
+                auto& tree_files = files[level[i].tree];
+                tree_files.insert(tree_files.end(), images[i].begin(), images[i].end());
+
+                for (auto& subdirectory : subdirectories[i])
+                {
+                    next_level.push_back(std::move(subdirectory));
+                }
+            }
+
+            level = std::move(next_level);
+        }
+
+        std::sort(files[0].begin(), files[0].end());
+        std::sort(files[1].begin(), files[1].end());
+
+        return true;
+    }
+
+    /* Required string fields are checked here, the comparison reports everything else */
+    bool get_string(const std::map<std::string, JsonValue>& fields, const std::string& key, bool required, std::string& value, std::string& error)
+    {
+        const auto it = fields.find(key);
+
+        if (it == fields.end() || it->second.type == JsonValue::Type::Null)
+        {
+            if (required)
+            {
+                error = "missing \"" + key + "\"";
+            }
+
+            return !required;
+        }
+
+        if (it->second.type != JsonValue::Type::String || it->second.text.empty())
+        {
+            error = "\"" + key + "\" must be a non-empty string";
+            return false;
+        }
+
+        value = it->second.text;
+
+        return true;
+    }
+
+    /* Prepares the comparison of one pair, out_filename has no extension. reference is ref_filename already prepared, if not null. */
+    void set_up_pair(PairTask& task, const std::string& ref_filename, const std::string& src_filename, const std::string& out_filename, const ComparisonSettings& settings,
+                     std::shared_ptr<const SharedReference> reference = nullptr)
+    {
+        task.line.add_string("ref", ref_filename).add_string("src", src_filename)
+                 .add_string("out", out_filename + output_format_extension(settings.output_format)).add_string("mode", settings.mode);
+
+        task.ref_filename = ref_filename;
+        task.src_filename = src_filename;
+        task.mode         = settings.mode;
+
+        if (reference)
+        {
+            task.comparison       = std::make_unique<ImageComparison>(std::move(reference), src_filename, out_filename, settings);
+            task.shared_reference = true;
+        }
+        else
+        {
+            task.comparison = std::make_unique<ImageComparison>(ref_filename, src_filename, out_filename, settings);
+        }
+    }
+
+    /* Appends the outcome to the result line of a pair that went through the pipeline */
+    void finish_pair(PairTask& task)
+    {
+        const double seconds = std::chrono::duration<double>(Clock::now() - task.start).count();
+        const ComparisonResult& result = task.comparison->result();
+
+        if (!result.ok)
+        {
+            task.line.add_string("status", "error").add_string("error", result.error_message).add_number("seconds", seconds);
+            return;
+        }
+
+        task.line.add_string("status", "ok").add_integer("width", result.width).add_integer("height", result.height)
+                 .add_bool("identical", result.identical).add_bool("saved", result.saved);
+
+        if (task.mode == "Luma")
+        {
+            task.line.add_number("mse", result.error).add_number("rmse", std::sqrt(result.error));
+        }
+        else
+        {
+            task.line.add_number("delta_e", result.error);
+        }
+
+        task.line.add_number("seconds", seconds);
+    }
+
+    /* Parses one manifest record */
+    void set_up_record(PairTask& task, const ManifestRecord& record, const ComparisonSettings& defaults)
+    {
+        JsonObjectWriter& line = task.line;
+        line.add_integer("line", int64_t(record.line_number));
+
+        std::map<std::string, JsonValue> fields;
+        std::string error;
+
+        ComparisonSettings settings = defaults;
+        std::string ref_filename, src_filename, out_filename, colormap_name;
+
+        if (!parse_json_object(record.text, fields, error))
+        {
+            line.add_string("status", "error").add_string("error", "invalid JSON: " + error);
+            return;
+        }
+
+        if (!get_string(fields, "ref", true, ref_filename, error) || !get_string(fields, "src", true, src_filename, error) ||
+            !get_string(fields, "out", true, out_filename, error) || !get_string(fields, "mode", false, settings.mode, error) ||
+            !get_string(fields, "colormap", false, colormap_name, error))
+        {
+            line.add_string("status", "error").add_string("error", error);
+            return;
+        }
+
+        /* stdin and stdout belong to the manifest and the results */
+        if (ref_filename == "-" || src_filename == "-" || out_filename == "-")
+        {
+            line.add_string("ref", ref_filename).add_string("src", src_filename)
+                .add_string("status", "error").add_string("error", "- isn't supported in batch mode");
+            return;
+        }
+
+        if (!colormap_name.empty())
+        {
+            settings.colormap_type = colormap_type_from_name(colormap_name);
+        }
+
+        split_output_extension(out_filename, settings.output_format);
+
+        set_up_pair(task, ref_filename, src_filename, out_filename, settings);
+    }
+
+    /*
+     * Runs set_up(i, task) for every i in [0, num_pairs) and pushes the pairs through a pipeline of three
+     * stages with their own threads: decode, compare and encode (diff image and metric files). The stages
+     * are connected by bounded queues, so at most a few decoded images or error maps wait between them
+     * and a slow stage throttles the ones before it. Each result line is written to results as soon as
+     * its pair leaves the pipeline (flushed, so consumers can follow the run).
+     */
+    RunStats run_pairs(size_t num_pairs, PipelineJobs jobs, const std::function<void(size_t, PairTask&)>& set_up, std::ostream& results)
+    {
+        RunStats stats;
+        stats.num_pairs = num_pairs;
+
+        const unsigned hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned* stage_jobs : { &jobs.decode, &jobs.compare, &jobs.encode })
+        {
+            *stage_jobs = unsigned(std::min<size_t>(*stage_jobs ? *stage_jobs : hardware_threads, std::max<size_t>(num_pairs, 1)));
+        }
+
+        stats.jobs = jobs;
+
+        /* Room for one waiting pair per consumer thread */
+        BoundedQueue<std::unique_ptr<PairTask>> compare_queue(jobs.compare);
+        BoundedQueue<std::unique_ptr<PairTask>> encode_queue(jobs.encode);
+
+        std::atomic<size_t>   next_pair(0);
+        std::atomic<unsigned> decoders_left(jobs.decode);
+        std::atomic<unsigned> comparers_left(jobs.compare);
+
+        std::mutex results_mutex;
+
+        auto report = [&](PairTask& task)
+        {
+            const bool ok = task.comparison && task.comparison->result().ok;
+
+            if (task.comparison)
+            {
+                finish_pair(task);
+            }
+
+            std::lock_guard<std::mutex> lock(results_mutex);
+
+            results << task.line.str() << std::endl;
+
+            stats.num_failed += ok ? 0 : 1;
+            stats.num_pixels += ok ? uint64_t(task.comparison->result().width) * uint64_t(task.comparison->result().height) : 0;
+        };
+
+        auto decoder = [&]
+        {
+            for (size_t i = next_pair++; i < num_pairs; i = next_pair++)
+            {
+                auto task = std::make_unique<PairTask>();
+                task->start = Clock::now();
+
+                set_up(i, *task);
+
+                bool decoded = false;
+
+                if (task->comparison && task->shared_reference)
+                {
+                    decoded = task->comparison->decode(MappedFile(task->src_filename));
+                }
+                else if (task->comparison)
+                {
+                    /* The encoded files are only needed until the images are decoded */
+                    const MappedFile ref_file(task->ref_filename);
+                    const MappedFile src_file(task->src_filename);
+
+                    decoded = task->comparison->decode(ref_file, src_file, false);
+                }
+
+                if (decoded)
+                {
+                    compare_queue.push(std::move(task));
+                }
+                else
+                {
+                    report(*task);
+                }
+            }
+
+            if (--decoders_left == 0)
+            {
+                compare_queue.close();
+            }
+        };
+
+        auto comparer = [&]
+        {
+            std::unique_ptr<PairTask> task;
+
+            while (compare_queue.pop(task))
+            {
+                if (task->comparison->compare())
+                {
+                    encode_queue.push(std::move(task));
+                }
+                else
+                {
+                    report(*task);
+                }
+            }
+
+            if (--comparers_left == 0)
+            {
+                encode_queue.close();
+            }
+        };
+
+        auto encoder = [&]
+        {
+            std::unique_ptr<PairTask> task;
+
+            while (encode_queue.pop(task))
+            {
+                task->comparison->save();
+                report(*task);
+            }
+        };
+
+        const auto start = Clock::now();
+
+        std::vector<std::thread> threads;
+
+        for (unsigned i = 0; i < jobs.decode; ++i)
+        {
+            threads.emplace_back(decoder);
+        }
+
+        for (unsigned i = 0; i < jobs.compare; ++i)
+        {
+            threads.emplace_back(comparer);
+        }
+
+        for (unsigned i = 0; i < jobs.encode; ++i)
+        {
+            threads.emplace_back(encoder);
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        return stats;
+    }
+
+    void print_summary(std::ostream& log, const RunStats& stats)
+    {
+        log << "Compared " << stats.num_pairs << " pairs (" << stats.num_failed << " failed) in " << stats.seconds << " s with " << stats.jobs.decode << "/" << stats.jobs.compare << "/" << stats.jobs.encode << " decode/compare/encode jobs: "
+            << (stats.seconds > 0.0 ? stats.num_pairs / stats.seconds : 0.0) << " pairs/s, "
+            << (stats.seconds > 0.0 ? stats.num_pixels / stats.seconds / 1e6 : 0.0) << " Mpixels/s" << std::endl;
+    }
+}
+
+bool run_batch(const std::string& manifest_filename, const ComparisonSettings& settings, PipelineJobs jobs, std::ostream& results, std::ostream& log)
+{
+    std::ifstream manifest_file;
+
+    if (manifest_filename != "-")
+    {
+        manifest_file.open(manifest_filename);
+
+        if (!manifest_file)
+        {
+            log << "Couldn't open manifest " << manifest_filename << std::endl;
+            return false;
+        }
+    }
+
+    std::istream& manifest = manifest_filename == "-" ? std::cin : manifest_file;
+
+    /* Manifests are small next to the images, so they're read up front */
+    std::vector<ManifestRecord> records;
+    std::string text;
+
+    for (size_t line_number = 1; std::getline(manifest, text); ++line_number)
+    {
+        if (!text.empty() && text.back() == '\r')
+        {
+            text.pop_back();
+        }
+
+        if (text.find_first_not_of(" \t") != std::string::npos)
+        {
+            records.push_back({ line_number, std::move(text) });
+        }
+    }
+
+    const RunStats stats = run_pairs(records.size(), jobs, [&](size_t i, PairTask& task)
+    {
+        set_up_record(task, records[i], settings);
+    }, results);
+
+    print_summary(log, stats);
+
+    return stats.num_failed == 0;
+}
+
+bool run_directory_diff(const std::string& ref_directory, const std::string& src_directory, const std::string& out_directory, const ComparisonSettings& settings,
+                        PipelineJobs jobs, std::ostream& results, std::ostream& log)
+{
+    const fs::path roots[2] = { fs::path(ref_directory), fs::path(src_directory) };
+
+    for (const auto& root : roots)
+    {
+        std::error_code error;
+
+        if (!fs::is_directory(root, error))
+        {
+            log << root.string() << " isn't a directory" << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<std::string> files[2];
+    std::string error;
+
+    if (!list_images(roots, files, error))
+    {
+        log << error << std::endl;
+        return false;
+    }
+
+    /* Both lists are sorted, so one merge pass finds the pairs and the files missing on either side */
+    std::vector<std::string> pairs;
+    size_t num_missing = 0;
+
+    for (size_t r = 0, s = 0; r < files[0].size() || s < files[1].size();)
+    {
+        const bool only_ref = s == files[1].size() || (r < files[0].size() && files[0][r] < files[1][s]);
+        const bool only_src = r == files[0].size() || (s < files[1].size() && files[1][s] < files[0][r]);
+
+        if (only_ref || only_src)
+        {
+            results << JsonObjectWriter().add_string("path", only_ref ? files[0][r++] : files[1][s++])
+                                         .add_string("status", only_ref ? "missing_src" : "missing_ref").str() << "\n";
+            ++num_missing;
+        }
+        else
+        {
+            pairs.push_back(files[0][r]);
+            ++r;
+            ++s;
+        }
+    }
+
+    results << std::flush;
+
+    /* The diff keeps the relative path, its extension comes from the output format */
+    std::vector<fs::path> out_paths(pairs.size());
+    std::map<fs::path, std::vector<size_t>> pairs_by_out_path;
+
+    for (size_t i = 0; i < pairs.size(); ++i)
+    {
+        out_paths[i] = (fs::path(out_directory) / fs::path(pairs[i])).replace_extension();
+        pairs_by_out_path[out_paths[i]].push_back(i);
+    }
+
+    const RunStats stats = run_pairs(pairs.size(), jobs, [&](size_t i, PairTask& task)
+    {
+        const fs::path relative(pairs[i]);
+        const fs::path& out_path = out_paths[i];
+
+        task.line.add_string("path", pairs[i]);
+
+        /* Images differing only in their extension (a.png, a.jpg) would overwrite each other's diff, so none of them is written */
+        const auto& same_out = pairs_by_out_path.at(out_path);
+
+        if (same_out.size() > 1)
+        {
+            std::string others;
+
+            for (size_t other : same_out)
+            {
+                if (other != i)
+                {
+                    others += (others.empty() ? "" : ", ") + pairs[other];
+                }
+            }
+
+            task.line.add_string("status", "error")
+                     .add_string("error", "diff image " + out_path.string() + output_format_extension(settings.output_format) + " would also be written for " + others);
+            return;
+        }
+
+        std::error_code directory_error;
+        fs::create_directories(out_path.parent_path(), directory_error);
+
+        if (directory_error)
+        {
+            task.line.add_string("status", "error").add_string("error", "Couldn't create " + out_path.parent_path().string() + ": " + directory_error.message());
+            return;
+        }
+
+        set_up_pair(task, (roots[0] / relative).string(), (roots[1] / relative).string(), out_path.string(), settings);
+    }, results);
+
+    print_summary(log, stats);
+
+    log << num_missing << " images present on one side only" << std::endl;
+
+    return stats.num_failed == 0 && num_missing == 0;
+}
+
+bool run_reference_diff(const std::string& ref_filename, MappedFile ref_file, const std::vector<std::string>& src_filenames, const std::string& out_filename,
+                        const ComparisonSettings& settings, PipelineJobs jobs, std::ostream& results, std::ostream& log)
+{
+    /* The reference is converted at one depth for all sources, so their headers are read first */
+    std::vector<int> bit_depths(src_filenames.size(), 8);
+
+    ThreadPool::global().parallel_for(src_filenames.size(), [&](size_t i)
+    {
+        ImageMetadata metadata;
+
+        /* Unreadable sources are reported by their comparison */
+        if (BaseComparator::read_metadata(src_filenames[i], metadata))
+        {
+            bit_depths[i] = metadata.bit_depth;
+        }
+    });
+
+    const int bit_depth = bit_depths.empty() ? 8 : *std::max_element(bit_depths.begin(), bit_depths.end());
+
+    const auto start = Clock::now();
+
+    std::string error;
+    const auto reference = SharedReference::create(ref_filename, std::move(ref_file), bit_depth, settings, error);
+
+    if (!reference)
+    {
+        log << error << std::endl;
+        return false;
+    }
+
+    log << "Prepared reference " << ref_filename << " in " << std::chrono::duration<double>(Clock::now() - start).count() << " s" << std::endl;
+
+    const RunStats stats = run_pairs(src_filenames.size(), jobs, [&](size_t i, PairTask& task)
+    {
+        task.line.add_integer("index", int64_t(i + 1));
+
+        set_up_pair(task, ref_filename, src_filenames[i], out_filename + "_" + std::to_string(i + 1), settings, reference);
+    }, results);
+
+    print_summary(log, stats);
+
+    return stats.num_failed == 0;
+}
@@ -0,0 +1,69 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ColormapLut.hpp"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+
+ColormapLut::ColormapLut(const tinycolormap::ColormapType& colormap_type, int interpolation_ranges)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        double value = double(i) / (size - 1);
+
+        if (interpolation_ranges > 0)
+        {
+            const int band = std::min(int(value * interpolation_ranges), interpolation_ranges - 1);
+            value = interpolation_ranges > 1 ? double(band) / (interpolation_ranges - 1) : 0.0;
+        }
+
+        const tinycolormap::Color color = tinycolormap::GetColor(value, colormap_type);
+
+        m_table[3 * i + 0] = color.ri();
+        m_table[3 * i + 1] = color.gi();
+        m_table[3 * i + 2] = color.bi();
+    }
+}
+
+std::shared_ptr<const ColormapLut> ColormapLut::get(const tinycolormap::ColormapType& colormap_type, int interpolation_ranges)
+{
+    static std::mutex mutex;
+    static std::map<std::pair<tinycolormap::ColormapType, int>, std::shared_ptr<const ColormapLut>> cache;
+
+    /* All non-positive values mean "interpolate", keep them under one key */
+    const auto key = std::make_pair(colormap_type, std::max(interpolation_ranges, 0));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& lut = cache[key];
+
+    if (!lut)
+    {
+        lut = std::make_shared<const ColormapLut>(key.first, key.second);
+    }
+
+    return lut;
+}
@@ -0,0 +1,161 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "CpuFeatures.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#ifdef COLORIMGDIFF_X86
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #include <immintrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+namespace
+{
+#ifdef COLORIMGDIFF_X86
+    void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuidex(info, int(leaf), int(subleaf));
+
+        for (int i = 0; i < 4; ++i)
+        {
+            regs[i] = uint32_t(info[i]);
+        }
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    uint64_t xgetbv0()
+    {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (uint64_t(edx) << 32) | eax;
+#endif
+    }
+
+    SimdLevel query_cpu()
+    {
+        uint32_t regs[4];
+
+        cpuid(0, 0, regs);
+        const uint32_t max_leaf = regs[0];
+
+        if (max_leaf < 1)
+        {
+            return SimdLevel::Scalar;
+        }
+
+        cpuid(1, 0, regs);
+        const bool sse41   = (regs[2] & (1u << 19)) != 0;
+        const bool fma     = (regs[2] & (1u << 12)) != 0;
+        const bool osxsave = (regs[2] & (1u << 27)) != 0;
+        const bool avx     = (regs[2] & (1u << 28)) != 0;
+
+        if (!sse41)
+        {
+            return SimdLevel::Scalar;
+        }
+
+        if (!osxsave || !avx || !fma || max_leaf < 7)
+        {
+            return SimdLevel::SSE41;
+        }
+
+        /* The OS has to save the YMM (bits 1-2) and, for AVX-512, the opmask/ZMM (bits 5-7) state */
+        const uint64_t xcr0 = xgetbv0();
+        const bool ymm_state = (xcr0 & 0x06) == 0x06;
+        const bool zmm_state = (xcr0 & 0xe6) == 0xe6;
+
+        cpuid(7, 0, regs);
+        const bool avx2    = (regs[1] & (1u << 5))  != 0;
+        const bool avx512f = (regs[1] & (1u << 16)) != 0;
+
+        if (!ymm_state || !avx2)
+        {
+            return SimdLevel::SSE41;
+        }
+
+        if (!zmm_state || !avx512f)
+        {
+            return SimdLevel::AVX2;
+        }
+
+        return SimdLevel::AVX512;
+    }
+#else
+    SimdLevel query_cpu()
+    {
+        return SimdLevel::Scalar;
+    }
+#endif
+
+    SimdLevel apply_user_cap(SimdLevel level)
+    {
+        const char* env = std::getenv("COLORIMGDIFF_SIMD");
+
+        if (!env)
+        {
+            return level;
+        }
+
+        const std::string requested(env);
+        SimdLevel cap = level;
+
+        if      (requested == "scalar") cap = SimdLevel::Scalar;
+        else if (requested == "sse4.1") cap = SimdLevel::SSE41;
+        else if (requested == "avx2")   cap = SimdLevel::AVX2;
+        else if (requested == "avx512") cap = SimdLevel::AVX512;
+
+        return cap < level ? cap : level;
+    }
+}
+
+SimdLevel detect_simd_level()
+{
+    static const SimdLevel level = apply_user_cap(query_cpu());
+    return level;
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::SSE41:  return "SSE4.1";
+        case SimdLevel::AVX2:   return "AVX2";
+        case SimdLevel::AVX512: return "AVX-512";
+        default:                return "scalar";
+    }
+}
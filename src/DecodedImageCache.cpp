@@ -0,0 +1,373 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "DecodedImageCache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+    #include <process.h>
+    #define getpid _getpid
+#else
+    #include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    /* Entries hold 8- or 16-bit pixels, the header's bit_depth tells which */
+    constexpr char entry_magic[8] = { 'C', 'I', 'D', 'I', 'M', 'G', '1', '\0' };
+    constexpr const char* entry_extension = ".rgb";
+    constexpr const char* temp_infix = ".rgb.tmp";
+
+    /* Writing an entry takes well under a second, older temporary files belong to crashed writers */
+    constexpr std::chrono::hours stale_temp_age(1);
+
+    bool is_temp_file(const fs::path& path)
+    {
+        return path.filename().string().find(temp_infix) != std::string::npos;
+    }
+
+    /* Native byte order, entries are only meant to be read on the machine type that wrote them */
+    struct EntryHeader
+    {
+        char     magic[8];
+        uint32_t width;
+        uint32_t height;
+        uint32_t nr_channels;
+        uint32_t bit_depth;
+        uint64_t data_size;
+    };
+
+    static_assert(sizeof(EntryHeader) == 32, "Cache entry header must stay 32 bytes");
+
+    /* XXH64 (https://github.com/Cyan4973/xxHash), fast enough to hash the file on every run */
+    class Xxh64
+    {
+    public:
+        static uint64_t hash(const uint8_t* data, size_t size, uint64_t seed = 0)
+        {
+            const uint8_t* const end = data + size;
+            uint64_t h;
+
+            if (size >= 32)
+            {
+                uint64_t v1 = seed + p1 + p2;
+                uint64_t v2 = seed + p2;
+                uint64_t v3 = seed;
+                uint64_t v4 = seed - p1;
+
+                do
+                {
+                    v1 = round(v1, read64(data));
+                    v2 = round(v2, read64(data + 8));
+                    v3 = round(v3, read64(data + 16));
+                    v4 = round(v4, read64(data + 24));
+                    data += 32;
+                } while (end - data >= 32);
+
+                h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+                h = merge(h, v1);
+                h = merge(h, v2);
+                h = merge(h, v3);
+                h = merge(h, v4);
+            }
+            else
+            {
+                h = seed + p5;
+            }
+
+            h += size;
+
+            for (; end - data >= 8; data += 8)
+            {
+                h ^= round(0, read64(data));
+                h  = rotl(h, 27) * p1 + p4;
+            }
+
+            if (end - data >= 4)
+            {
+                h ^= uint64_t(read32(data)) * p1;
+                h  = rotl(h, 23) * p2 + p3;
+                data += 4;
+            }
+
+            for (; data < end; ++data)
+            {
+                h ^= *data * p5;
+                h  = rotl(h, 11) * p1;
+            }
+
+            h ^= h >> 33;
+            h *= p2;
+            h ^= h >> 29;
+            h *= p3;
+            h ^= h >> 32;
+
+            return h;
+        }
+
+    private:
+        static constexpr uint64_t p1 = 11400714785074694791ull;
+        static constexpr uint64_t p2 = 14029467366897019727ull;
+        static constexpr uint64_t p3 = 1609587929392839161ull;
+        static constexpr uint64_t p4 = 9650029242287828579ull;
+        static constexpr uint64_t p5 = 2870177450012600261ull;
+
+        static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+        static uint64_t read64(const uint8_t* p) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+        static uint32_t read32(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+
+        static uint64_t round(uint64_t acc, uint64_t input)
+        {
+            acc += input * p2;
+            acc  = rotl(acc, 31);
+            return acc * p1;
+        }
+
+        static uint64_t merge(uint64_t acc, uint64_t value)
+        {
+            acc ^= round(0, value);
+            return acc * p1 + p4;
+        }
+    };
+}
+
+DecodedImageCache::DecodedImageCache(const std::string& directory, uint64_t max_bytes)
+    : m_directory(directory),
+      m_max_bytes(max_bytes),
+      m_total_size(0)
+{
+    std::error_code error;
+    fs::create_directories(m_directory, error);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    evict();
+}
+
+Image DecodedImageCache::load(const ImageView& encoded, ImageMetadata& img_data)
+{
+    const std::string path = entry_path(encoded, img_data.bit_depth);
+
+    Image img = read_entry(path, img_data);
+
+    if (!img.empty())
+    {
+        /* Refresh the entry for LRU eviction */
+        std::error_code error;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+
+        return img;
+    }
+
+    img = BaseComparator::decode_image(encoded, img_data);
+
+    if (!img.empty())
+    {
+        const uint64_t entry_size = write_entry(path, img, img_data);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_total_size += entry_size;
+
+        if (m_total_size > m_max_bytes)
+        {
+            evict();
+        }
+    }
+
+    return img;
+}
+
+std::string DecodedImageCache::entry_path(const ImageView& encoded, int bit_depth) const
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%llx-%d%s", (unsigned long long)Xxh64::hash(encoded.data(), encoded.size()),
+                  (unsigned long long)encoded.size(), bit_depth, entry_extension);
+
+    return (fs::path(m_directory) / name).string();
+}
+
+Image DecodedImageCache::read_entry(const std::string& path, ImageMetadata& img_data) const
+{
+    auto entry = std::make_shared<MappedFile>(path);
+
+    if (!entry->is_open() || entry->size() < sizeof(EntryHeader))
+    {
+        return Image();
+    }
+
+    EntryHeader header;
+    std::memcpy(&header, entry->data(), sizeof(header));
+
+    const uint64_t expected_size = uint64_t(header.width) * header.height * header.nr_channels * (header.bit_depth / 8);
+
+    if (std::memcmp(header.magic, entry_magic, sizeof(entry_magic)) != 0 || header.nr_channels != 3 ||
+        header.bit_depth != uint32_t(img_data.bit_depth) ||
+        header.data_size != expected_size || entry->size() != sizeof(EntryHeader) + expected_size)
+    {
+        return Image();
+    }
+
+    img_data.width               = int(header.width);
+    img_data.height              = int(header.height);
+    img_data.nr_channels         = int(header.nr_channels);
+    img_data.nr_channels_in_file = int(header.nr_channels);
+    img_data.bit_depth           = int(header.bit_depth);
+
+    /* The pixels stay in the mapping, which lives as long as the image */
+    auto* pixels = const_cast<uint8_t*>(entry->data() + sizeof(EntryHeader));
+
+    return Image(pixels, size_t(expected_size), [entry](uint8_t*) {}, int(header.bit_depth));
+}
+
+uint64_t DecodedImageCache::write_entry(const std::string& path, const Image& img, const ImageMetadata& img_data) const
+{
+    EntryHeader header;
+    std::memcpy(header.magic, entry_magic, sizeof(entry_magic));
+    header.width       = uint32_t(img_data.width);
+    header.height      = uint32_t(img_data.height);
+    header.nr_channels = uint32_t(img_data.nr_channels);
+    header.bit_depth   = uint32_t(img.bit_depth());
+    header.data_size   = img.size();
+
+    /* Written under a unique name and renamed, so concurrent readers never see a partial entry */
+    static std::atomic<unsigned> temp_counter(0);
+
+    const std::string temp_path = path + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(temp_counter++);
+
+    FILE* file = std::fopen(temp_path.c_str(), "wb");
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(img.data(), 1, img.size(), file) == img.size();
+
+    ok = std::fclose(file) == 0 && ok;
+
+    std::error_code error;
+
+    if (ok)
+    {
+        fs::rename(temp_path, path, error);
+    }
+
+    if (!ok || error)
+    {
+        fs::remove(temp_path, error);
+        return 0;
+    }
+
+    return sizeof(header) + img.size();
+}
+
+void DecodedImageCache::evict()
+{
+    struct Entry
+    {
+        fs::path            path;
+        fs::file_time_type  time;
+        uint64_t            size;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total_size = 0;
+
+    const auto now = fs::file_time_type::clock::now();
+
+    std::error_code error;
+
+    for (fs::directory_iterator it(m_directory, error), end; !error && it != end; it.increment(error))
+    {
+        const bool temp_file = is_temp_file(it->path());
+
+        if (!temp_file && it->path().extension() != entry_extension)
+        {
+            continue;
+        }
+
+        std::error_code entry_error;
+
+        Entry entry { it->path(), fs::last_write_time(it->path(), entry_error), uint64_t(fs::file_size(it->path(), entry_error)) };
+
+        if (entry_error)
+        {
+            continue;
+        }
+
+        if (temp_file)
+        {
+            /* Temporary files of live writers are counted but never evicted, they're renamed soon */
+            if (now - entry.time > stale_temp_age)
+            {
+                fs::remove(entry.path, entry_error);
+            }
+            else
+            {
+                total_size += entry.size;
+            }
+
+            continue;
+        }
+
+        total_size += entry.size;
+        entries.push_back(std::move(entry));
+    }
+
+    if (total_size > m_max_bytes)
+    {
+        /* Evicting below the limit leaves room for a few inserts before the next rescan */
+        const uint64_t target_size = m_max_bytes - m_max_bytes / 4;
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+
+        /* Other processes may remove the same entries, errors are ignored */
+        for (const auto& entry : entries)
+        {
+            if (total_size <= target_size)
+            {
+                break;
+            }
+
+            fs::remove(entry.path, error);
+            total_size -= entry.size;
+        }
+    }
+
+    m_total_size = total_size;
+}
@@ -0,0 +1,376 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "FixedPointLumaComparator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+#include "LumaKernels.hpp"
+#include "ThreadPool.hpp"
+
+namespace
+{
+    /*
+     * Square of the difference of two normalized luma values. |a - b| can reach unit, whose square
+     * overflows int32_t but fits in uint64_t; unsigned arithmetic wraps, so it gives the exact square.
+     */
+    inline uint64_t squared_difference(uint32_t a, uint32_t b)
+    {
+        const uint64_t diff = uint64_t(int64_t(a) - int64_t(b));
+        return diff * diff;
+    }
+
+    /* Luma relative to the minimum of its image, normalized to [0, unit] */
+    inline uint32_t normalize(uint32_t luma, uint32_t min, double ratio)
+    {
+        return uint32_t(double(luma - min) * ratio + 0.5);
+    }
+}
+
+FixedPointLumaComparator::FixedPointLumaComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges)
+    : BaseComparator(colormap_type, out_filename, width, height, interpolation_ranges),
+      m_mse         (0.0),
+      m_mse_image   (size_t(width) * height),
+      m_min_error   (0.0f),
+      m_max_error   (0.0f)
+{
+}
+
+FixedPointLumaComparator::~FixedPointLumaComparator()
+{
+}
+
+void FixedPointLumaComparator::compare(const ImageView& ref_img, const ImageView& src_image)
+{
+    constexpr size_t chunk_size = 1024;
+
+    const auto luma_kernel = select_luma_kernel<uint32_t>();
+    const size_t num_pixels = ref_img.size() / 3;
+    const size_t tiles      = num_tiles(num_pixels);
+
+    auto& pool = ThreadPool::global();
+
+    /* Pass 1: luminance range of both images, exact since luma is an integer */
+    struct LumaRange
+    {
+        uint32_t ref_min = std::numeric_limits<uint32_t>::max(), ref_max = 0;
+        uint32_t src_min = std::numeric_limits<uint32_t>::max(), src_max = 0;
+    };
+
+    std::vector<LumaRange> tile_ranges(tiles);
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        std::array<uint32_t, chunk_size> ref_luma;
+        std::array<uint32_t, chunk_size> src_luma;
+
+        LumaRange range;
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t offset = tile * tile_size; offset < end; offset += chunk_size)
+        {
+            const size_t count = std::min(chunk_size, end - offset);
+
+            luma_kernel(&ref_img[3 * offset],   ref_luma.data(), count);
+            luma_kernel(&src_image[3 * offset], src_luma.data(), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                range.ref_min = std::min(range.ref_min, ref_luma[i]);
+                range.ref_max = std::max(range.ref_max, ref_luma[i]);
+                range.src_min = std::min(range.src_min, src_luma[i]);
+                range.src_max = std::max(range.src_max, src_luma[i]);
+            }
+        }
+
+        tile_ranges[tile] = range;
+    });
+
+    LumaRange range;
+
+    for (const auto& tile_range : tile_ranges)
+    {
+        range.ref_min = std::min(range.ref_min, tile_range.ref_min);
+        range.ref_max = std::max(range.ref_max, tile_range.ref_max);
+        range.src_min = std::min(range.src_min, tile_range.src_min);
+        range.src_max = std::max(range.src_max, tile_range.src_max);
+    }
+
+    /* Rounded in double, so the normalized luma is within 0.5 / unit of the double path's */
+    const double ref_ratio = double(unit) / double(range.ref_max > range.ref_min ? range.ref_max - range.ref_min : 1);
+    const double src_ratio = double(unit) / double(range.src_max > range.src_min ? range.src_max - range.src_min : 1);
+
+    /* Pass 2: normalize, diff and square in 64-bit integers */
+
+    /* The error map holds squared differences of luma normalized to [0, 1], like LumaComparator's */
+    const float err_scale = 1.0f / (float(unit) * float(unit));
+
+    std::vector<TileError> tile_errors(tiles);
+
+    std::vector<float>& mse_image = m_mse_image;
+    mse_image.resize(num_pixels);
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        std::array<uint32_t, chunk_size> ref_luma;
+        std::array<uint32_t, chunk_size> src_luma;
+
+        TileError error;
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t offset = tile * tile_size; offset < end; offset += chunk_size)
+        {
+            const size_t count = std::min(chunk_size, end - offset);
+
+            luma_kernel(&ref_img[3 * offset],   ref_luma.data(), count);
+            luma_kernel(&src_image[3 * offset], src_luma.data(), count);
+
+            /* |diff| <= unit < 2^24, so a square is below 2^48 and even a full tile sums to less than 2^64 */
+            uint64_t chunk_sum = 0;
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                const uint64_t err = squared_difference(normalize(ref_luma[i], range.ref_min, ref_ratio),
+                                                        normalize(src_luma[i], range.src_min, src_ratio));
+
+                chunk_sum += err;
+
+                mse_image[offset + i] = float(err) * err_scale;
+
+                error.min_err = std::min(error.min_err, err);
+                error.max_err = std::max(error.max_err, err);
+            }
+
+            error.sum += chunk_sum;
+        }
+
+        tile_errors[tile] = error;
+    });
+
+    reduce_tile_errors(tile_errors, num_pixels);
+}
+
+std::shared_ptr<const PreparedReference> FixedPointLumaComparator::prepare_reference(const ImageView& ref_img) const
+{
+    constexpr size_t chunk_size = 1024;
+
+    const auto luma_kernel = select_luma_kernel<uint32_t>();
+    const size_t num_pixels = ref_img.size() / 3;
+    const size_t tiles      = num_tiles(num_pixels);
+
+    auto& pool = ThreadPool::global();
+
+    auto reference = std::make_shared<Reference>();
+    reference->luma.resize(num_pixels);
+
+    /* Raw luma of the whole image, kept until its range is known */
+    std::vector<uint32_t> luma(num_pixels);
+    std::vector<std::pair<uint32_t, uint32_t>> tile_ranges(tiles);
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        uint32_t min = std::numeric_limits<uint32_t>::max();
+        uint32_t max = 0;
+
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t offset = tile * tile_size; offset < end; offset += chunk_size)
+        {
+            const size_t count = std::min(chunk_size, end - offset);
+
+            luma_kernel(&ref_img[3 * offset], &luma[offset], count);
+
+            for (size_t i = offset; i < offset + count; ++i)
+            {
+                min = std::min(min, luma[i]);
+                max = std::max(max, luma[i]);
+            }
+        }
+
+        tile_ranges[tile] = { min, max };
+    });
+
+    uint32_t ref_min = std::numeric_limits<uint32_t>::max();
+    uint32_t ref_max = 0;
+
+    for (const auto& tile_range : tile_ranges)
+    {
+        ref_min = std::min(ref_min, tile_range.first);
+        ref_max = std::max(ref_max, tile_range.second);
+    }
+
+    /* The same rounding as in compare(), so both paths give identical results */
+    const double ref_ratio = double(unit) / double(ref_max > ref_min ? ref_max - ref_min : 1);
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t i = tile * tile_size; i < end; ++i)
+        {
+            reference->luma[i] = normalize(luma[i], ref_min, ref_ratio);
+        }
+    });
+
+    return reference;
+}
+
+void FixedPointLumaComparator::compare(const PreparedReference& ref, const ImageView& src_image)
+{
+    constexpr size_t chunk_size = 1024;
+
+    const std::vector<uint32_t>& ref_luma = static_cast<const Reference&>(ref).luma;
+
+    const auto luma_kernel = select_luma_kernel<uint32_t>();
+    const size_t num_pixels = src_image.size() / 3;
+    const size_t tiles      = num_tiles(num_pixels);
+
+    auto& pool = ThreadPool::global();
+
+    /* Pass 1: luminance range of the source */
+    std::vector<std::pair<uint32_t, uint32_t>> tile_ranges(tiles);
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        std::array<uint32_t, chunk_size> src_luma;
+
+        uint32_t min = std::numeric_limits<uint32_t>::max();
+        uint32_t max = 0;
+
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t offset = tile * tile_size; offset < end; offset += chunk_size)
+        {
+            const size_t count = std::min(chunk_size, end - offset);
+
+            luma_kernel(&src_image[3 * offset], src_luma.data(), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                min = std::min(min, src_luma[i]);
+                max = std::max(max, src_luma[i]);
+            }
+        }
+
+        tile_ranges[tile] = { min, max };
+    });
+
+    uint32_t src_min = std::numeric_limits<uint32_t>::max();
+    uint32_t src_max = 0;
+
+    for (const auto& tile_range : tile_ranges)
+    {
+        src_min = std::min(src_min, tile_range.first);
+        src_max = std::max(src_max, tile_range.second);
+    }
+
+    const double src_ratio = double(unit) / double(src_max > src_min ? src_max - src_min : 1);
+    const float err_scale = 1.0f / (float(unit) * float(unit));
+
+    /* Pass 2: normalize the source and diff it with the normalized reference */
+    std::vector<TileError> tile_errors(tiles);
+
+    std::vector<float>& mse_image = m_mse_image;
+    mse_image.resize(num_pixels);
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        std::array<uint32_t, chunk_size> src_luma;
+
+        TileError error;
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t offset = tile * tile_size; offset < end; offset += chunk_size)
+        {
+            const size_t count = std::min(chunk_size, end - offset);
+
+            luma_kernel(&src_image[3 * offset], src_luma.data(), count);
+
+            uint64_t chunk_sum = 0;
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                const uint64_t err = squared_difference(ref_luma[offset + i], normalize(src_luma[i], src_min, src_ratio));
+
+                chunk_sum += err;
+
+                mse_image[offset + i] = float(err) * err_scale;
+
+                error.min_err = std::min(error.min_err, err);
+                error.max_err = std::max(error.max_err, err);
+            }
+
+            error.sum += chunk_sum;
+        }
+
+        tile_errors[tile] = error;
+    });
+
+    reduce_tile_errors(tile_errors, num_pixels);
+}
+
+void FixedPointLumaComparator::reduce_tile_errors(const std::vector<TileError>& tile_errors, size_t num_pixels)
+{
+    /*
+     * Integer sums are exact, so the combination order doesn't matter. Tile sums can come
+     * close to 2^64, so they are added up in 128 bits, as a high and a low word with carry.
+     */
+    uint64_t sum_low  = 0;
+    uint64_t sum_high = 0;
+    uint64_t min_err  = std::numeric_limits<uint64_t>::max();
+    uint64_t max_err  = 0;
+
+    for (const auto& error : tile_errors)
+    {
+        sum_low  += error.sum;
+        sum_high += sum_low < error.sum ? 1 : 0;
+        min_err   = std::min(min_err, error.min_err);
+        max_err   = std::max(max_err, error.max_err);
+    }
+
+    /* The error map holds squared differences of luma normalized to [0, 1], like LumaComparator's */
+    const float err_scale = 1.0f / (float(unit) * float(unit));
+
+    /* unit^2 is below 2^48, so it is exact in double */
+    const double sum = std::ldexp(double(sum_high), 64) + double(sum_low);
+
+    m_mse = sum / (double(unit) * double(unit)) / double(num_pixels);
+
+    m_min_error = float(min_err) * err_scale;
+    m_max_error = float(max_err) * err_scale;
+}
+
+bool FixedPointLumaComparator::save()
+{
+    /* Normalization to [0, 1] happens while writing, the range is already known */
+    return save_diff_image(m_mse_image, m_min_error, m_max_error);
+}
+
+double FixedPointLumaComparator::get_error() const
+{
+    return m_mse;
+}
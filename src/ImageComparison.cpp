@@ -0,0 +1,503 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ImageComparison.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+
+#include "BaseComparator.hpp"
+#include "CpuFeatures.hpp"
+#include "FixedPointLumaComparator.hpp"
+#include "LumaComparator.hpp"
+#include "ThreadPool.hpp"
+
+namespace
+{
+    /* Instantiates Comparator<float> or Comparator<double> depending on the requested precision */
+    template<template<typename> class Comparator, typename... Args>
+    std::shared_ptr<BaseComparator> createComparator(const std::string& precision, Args&&... args)
+    {
+        if (precision == "double")
+        {
+            return std::make_shared<Comparator<double>>(std::forward<Args>(args)...);
+        }
+
+        return std::make_shared<Comparator<float>>(std::forward<Args>(args)...);
+    }
+
+    /* Mode and precision are plain strings so that batch records can override them, they're checked per comparison */
+    bool check_settings(const ComparisonSettings& settings, std::string& error)
+    {
+        if (settings.mode != "Luma" && settings.mode != "Lab")
+        {
+            error = "Unknown comparison mode " + settings.mode;
+            return false;
+        }
+
+        if (!is_precision_name(settings.precision) || (settings.precision == "fixed" && settings.mode != "Luma"))
+        {
+            error = "Precision " + settings.precision + " isn't supported in " + settings.mode + " mode";
+            return false;
+        }
+
+        return true;
+    }
+
+    /* The comparator for settings' mode and precision, its buffers are sized from the header values in metadata */
+    std::shared_ptr<BaseComparator> makeComparator(const ComparisonSettings& settings, const std::string& out_filename, const ImageMetadata& metadata)
+    {
+        std::shared_ptr<BaseComparator> comparator;
+
+        if (settings.mode == "Luma")
+        {
+            /* The integer path is exact for 8-bit inputs only */
+            if (settings.precision == "fixed" && metadata.bit_depth == 8)
+            {
+                comparator = std::make_shared<FixedPointLumaComparator>(settings.colormap_type, out_filename, metadata.width, metadata.height, settings.interpolation_ranges);
+            }
+            else
+            {
+                comparator = createComparator<LumaComparator>(settings.precision == "fixed" ? "double" : settings.precision, settings.colormap_type, out_filename,
+                                                              metadata.width, metadata.height, settings.interpolation_ranges);
+            }
+        }
+        else
+        {
+            comparator = createComparator<LabComparator>(settings.precision, settings.colormap_type, out_filename, metadata.width, metadata.height,
+                                                         settings.interpolation_ranges, settings.palette_cache_mode);
+        }
+
+        comparator->set_output_format(settings.output_format);
+        comparator->set_png_speed(settings.png_speed);
+
+        return comparator;
+    }
+}
+
+bool is_precision_name(const std::string& name)
+{
+    return name == "float" || name == "double" || name == "fixed";
+}
+
+tinycolormap::ColormapType colormap_type_from_name(const std::string& name)
+{
+    static const std::unordered_map<std::string, tinycolormap::ColormapType> colormaps =
+    {
+        {"Parula",  tinycolormap::ColormapType::Parula},
+        {"Heat",    tinycolormap::ColormapType::Heat},
+        {"Hot",     tinycolormap::ColormapType::Hot},
+        {"Jet",     tinycolormap::ColormapType::Jet},
+        {"Gray",    tinycolormap::ColormapType::Gray},
+        {"Magma",   tinycolormap::ColormapType::Magma},
+        {"Inferno", tinycolormap::ColormapType::Inferno},
+        {"Plasma",  tinycolormap::ColormapType::Plasma},
+        {"Viridis", tinycolormap::ColormapType::Viridis},
+        {"Cividis", tinycolormap::ColormapType::Cividis},
+        {"Github",  tinycolormap::ColormapType::Github}
+    };
+
+    const auto it = colormaps.find(name);
+
+    return it != colormaps.end() ? it->second : tinycolormap::ColormapType::Hot;
+}
+
+SharedReference::SharedReference(const std::string& filename, MappedFile file, const ImageMetadata& metadata, std::shared_ptr<const PreparedReference> prepared)
+    : m_filename(filename),
+      m_file    (std::move(file)),
+      m_metadata(metadata),
+      m_prepared(std::move(prepared)) {}
+
+std::shared_ptr<const SharedReference> SharedReference::create(const std::string& filename, MappedFile file, int bit_depth, const ComparisonSettings& settings,
+                                                               std::string& error)
+{
+    const ImageView encoded(file.data(), file.size());
+
+    ImageMetadata metadata;
+
+    if (!file.is_open() || !BaseComparator::read_metadata(encoded, metadata))
+    {
+        error = "Couldn't load " + filename;
+        return nullptr;
+    }
+
+    if (!check_settings(settings, error))
+    {
+        return nullptr;
+    }
+
+    metadata.bit_depth = std::max(metadata.bit_depth, bit_depth);
+
+    ImageMetadata decoded = metadata;
+    const Image image = settings.ref_cache ? settings.ref_cache->load(encoded, decoded) : BaseComparator::decode_image(encoded, decoded);
+
+    if (image.empty() || decoded.width != metadata.width || decoded.height != metadata.height)
+    {
+        error = "Couldn't load " + filename;
+        return nullptr;
+    }
+
+    /* Only used for the conversion, each comparison gets its own comparator */
+    auto prepared = makeComparator(settings, std::string(), metadata)->prepare_reference(image);
+
+    return std::shared_ptr<const SharedReference>(new SharedReference(filename, std::move(file), metadata, std::move(prepared)));
+}
+
+ImageComparison::ImageComparison(const std::string& ref_filename, const std::string& src_filename, const std::string& out_filename, const ComparisonSettings& settings,
+                                 std::ostream* log)
+    : m_ref_filename(ref_filename),
+      m_src_filename(src_filename),
+      m_out_filename(out_filename),
+      m_settings    (settings),
+      m_log         (log) {}
+
+ImageComparison::ImageComparison(std::shared_ptr<const SharedReference> reference, const std::string& src_filename, const std::string& out_filename,
+                                 const ComparisonSettings& settings, std::ostream* log)
+    : m_ref_filename(reference->filename()),
+      m_src_filename(src_filename),
+      m_out_filename(out_filename),
+      m_settings    (settings),
+      m_log         (log),
+      m_reference   (std::move(reference)) {}
+
+bool ImageComparison::decode(const MappedFile& ref_file, const MappedFile& src_file, bool decode_concurrently)
+{
+    const ImageView ref_encoded(ref_file.data(), ref_file.size());
+    const ImageView src_encoded(src_file.data(), src_file.size());
+
+    ImageMetadata ref_metadata, src_metadata;
+
+    /* Preflight: only the headers are read, so incompatible pairs are rejected before any decoding */
+    if (!ref_file.is_open() || !BaseComparator::read_metadata(ref_encoded, ref_metadata))
+    {
+        return fail("Couldn't load " + m_ref_filename);
+    }
+
+    if (!src_file.is_open() || !BaseComparator::read_metadata(src_encoded, src_metadata))
+    {
+        return fail("Couldn't load " + m_src_filename);
+    }
+
+    if (ref_metadata.width != src_metadata.width || ref_metadata.height != src_metadata.height)
+    {
+        return fail("Ref and Src images' dimensions don't match! (" + std::to_string(ref_metadata.width) + "x" + std::to_string(ref_metadata.height) + " vs " +
+                    std::to_string(src_metadata.width) + "x" + std::to_string(src_metadata.height) + ")");
+    }
+
+    std::string settings_error;
+
+    if (!check_settings(m_settings, settings_error))
+    {
+        return fail(settings_error);
+    }
+
+    /* 16-bit files are compared at full precision, an 8-bit counterpart is widened by the decoder */
+    const int bit_depth = std::max(ref_metadata.bit_depth, src_metadata.bit_depth);
+
+    ref_metadata.bit_depth = bit_depth;
+    src_metadata.bit_depth = bit_depth;
+
+    m_result.width     = ref_metadata.width;
+    m_result.height    = ref_metadata.height;
+    m_result.bit_depth = bit_depth;
+
+    /* Byte-identical files have zero error, so the whole pipeline can be skipped */
+    m_result.identical = MappedFile::same_contents(ref_file, src_file);
+
+    /* The decoders fill in their own copies, the header values are read while they run */
+    ImageMetadata ref_decoded = ref_metadata;
+    ImageMetadata src_decoded = src_metadata;
+
+    auto decode_ref = [&]
+    {
+        /* References are usually compared many times, so only they go through the cache */
+        if (m_settings.ref_cache)
+        {
+            return m_settings.ref_cache->load(ref_encoded, ref_decoded);
+        }
+
+        return BaseComparator::decode_image(ref_encoded, ref_decoded);
+    };
+
+    auto decode_src = [&] { return BaseComparator::decode_image(src_encoded, src_decoded); };
+
+    std::future<Image> ref_future, src_future;
+
+    if (!m_result.identical && decode_concurrently)
+    {
+        /* Decoding usually dominates a run, so both images are decoded at the same time */
+        ref_future = std::async(std::launch::async, decode_ref);
+        src_future = std::async(std::launch::async, decode_src);
+    }
+
+    /* Meanwhile prepare the comparator, its buffers are sized from the headers */
+    m_comparator = makeComparator(m_settings, m_out_filename, ref_metadata);
+
+    /* Worker threads and SIMD detection are set up while the decodes run as well */
+    ThreadPool::global();
+    detect_simd_level();
+
+    if (m_result.identical)
+    {
+        if (m_log)
+        {
+            *m_log << "Ref and Src files are byte-identical, skipping comparison" << std::endl;
+        }
+
+        return true;
+    }
+
+    m_ref_image = decode_concurrently ? ref_future.get() : decode_ref();
+    m_src_image = decode_concurrently ? src_future.get() : decode_src();
+
+    if (m_ref_image.empty())
+    {
+        return fail("Couldn't load " + m_ref_filename);
+    }
+
+    if (m_src_image.empty())
+    {
+        return fail("Couldn't load " + m_src_filename);
+    }
+
+    /* The decoders must agree with the headers, the comparator buffers were sized from them */
+    if (m_ref_image.size() != m_src_image.size() || ref_decoded.width != ref_metadata.width || ref_decoded.height != ref_metadata.height ||
+        src_decoded.width != src_metadata.width || src_decoded.height != src_metadata.height)
+    {
+        return fail("Ref and Src images' dimensions don't match!");
+    }
+
+    return true;
+}
+
+bool ImageComparison::decode(const MappedFile& src_file)
+{
+    const ImageView src_encoded(src_file.data(), src_file.size());
+    const ImageMetadata& ref_metadata = m_reference->metadata();
+
+    ImageMetadata src_metadata;
+
+    if (!src_file.is_open() || !BaseComparator::read_metadata(src_encoded, src_metadata))
+    {
+        return fail("Couldn't load " + m_src_filename);
+    }
+
+    if (ref_metadata.width != src_metadata.width || ref_metadata.height != src_metadata.height)
+    {
+        return fail("Ref and Src images' dimensions don't match! (" + std::to_string(ref_metadata.width) + "x" + std::to_string(ref_metadata.height) + " vs " +
+                    std::to_string(src_metadata.width) + "x" + std::to_string(src_metadata.height) + ")");
+    }
+
+    /* The reference was converted once at a fixed depth, 8-bit sources are widened to it */
+    if (src_metadata.bit_depth > ref_metadata.bit_depth)
+    {
+        return fail("Src image is " + std::to_string(src_metadata.bit_depth) + "-bit, but the reference was prepared at " + std::to_string(ref_metadata.bit_depth) + " bits");
+    }
+
+    src_metadata.bit_depth = ref_metadata.bit_depth;
+
+    m_result.width     = ref_metadata.width;
+    m_result.height    = ref_metadata.height;
+    m_result.bit_depth = ref_metadata.bit_depth;
+
+    m_result.identical = MappedFile::same_contents(m_reference->file(), src_file);
+
+    m_comparator = makeComparator(m_settings, m_out_filename, ref_metadata);
+
+    if (m_result.identical)
+    {
+        if (m_log)
+        {
+            *m_log << "Ref and Src files are byte-identical, skipping comparison" << std::endl;
+        }
+
+        return true;
+    }
+
+    ImageMetadata src_decoded = src_metadata;
+    m_src_image = BaseComparator::decode_image(src_encoded, src_decoded);
+
+    if (m_src_image.empty())
+    {
+        return fail("Couldn't load " + m_src_filename);
+    }
+
+    if (src_decoded.width != src_metadata.width || src_decoded.height != src_metadata.height)
+    {
+        return fail("Ref and Src images' dimensions don't match!");
+    }
+
+    return true;
+}
+
+bool ImageComparison::compare()
+{
+    if (!m_comparator)
+    {
+        return false;
+    }
+
+    if (!m_result.identical)
+    {
+        if (m_log)
+        {
+            if (m_settings.mode == "Luma")
+            {
+                *m_log << "Comparing luminance (" << (m_result.bit_depth > 8 ? "16-bit" : simd_level_name(detect_simd_level())) << " kernel)..." << std::endl;
+            }
+            else
+            {
+                *m_log << "Comparing color in L*a*b* space" << (m_result.bit_depth > 8 ? " (16-bit)" : "") << "..." << std::endl;
+            }
+        }
+
+        if (m_reference)
+        {
+            m_comparator->compare(m_reference->prepared(), m_src_image);
+        }
+        else
+        {
+            m_comparator->compare(m_ref_image, m_src_image);
+        }
+    }
+
+    m_ref_image = Image();
+    m_src_image = Image();
+
+    return true;
+}
+
+bool ImageComparison::save()
+{
+    if (!m_comparator)
+    {
+        return false;
+    }
+
+    const bool out_to_stdout = m_out_filename == "-";
+
+    if (!(m_result.identical && m_settings.skip_identical_output))
+    {
+        const bool written = m_result.identical ? m_comparator->save_identical() : m_comparator->save();
+
+        if (!written)
+        {
+            return fail(out_to_stdout ? std::string("Couldn't write the diff image to stdout")
+                                      : "Couldn't write " + m_out_filename + output_format_extension(m_settings.output_format));
+        }
+
+        m_result.saved = true;
+    }
+
+    m_result.ok    = true;
+    m_result.error = m_comparator->get_error();
+
+    /* With the diff image on stdout, metric files still need a name */
+    const std::string metric_stem = out_to_stdout ? "output_diff" : m_out_filename;
+
+    if (m_log && m_result.saved)
+    {
+        if (out_to_stdout)
+        {
+            *m_log << "Wrote image to stdout" << std::endl;
+        }
+        else
+        {
+            *m_log << "Saved image " << m_out_filename << output_format_extension(m_settings.output_format) << std::endl;
+        }
+    }
+
+    if (m_settings.mode == "Luma")
+    {
+        if (m_log)
+        {
+            *m_log << "MSE:  " << m_result.error << std::endl;
+            *m_log << "RMSE: " << std::sqrt(m_result.error) << std::endl;
+        }
+
+        if (m_settings.print_metric_to_file)
+        {
+            std::ofstream out_file(metric_stem + "_mse.txt");
+            out_file << m_result.error;
+            out_file.close();
+
+            out_file.open(metric_stem + "_rmse.txt");
+            out_file << std::sqrt(m_result.error);
+        }
+    }
+    else
+    {
+        if (m_log)
+        {
+            *m_log << "delta E*ab:  " << m_result.error << std::endl;
+
+            if (!m_result.identical)
+            {
+                m_comparator->print_stats(*m_log);
+            }
+        }
+
+        if (m_settings.print_metric_to_file)
+        {
+            std::ofstream out_file(metric_stem + "_delta_e.txt");
+            out_file << m_result.error;
+        }
+    }
+
+    /* The error map isn't needed anymore */
+    m_comparator.reset();
+
+    return true;
+}
+
+bool ImageComparison::fail(const std::string& message)
+{
+    m_result.ok            = false;
+    m_result.error_message = message;
+
+    m_comparator.reset();
+    m_ref_image = Image();
+    m_src_image = Image();
+
+    return false;
+}
+
+ComparisonResult compare_images(const std::string& ref_filename, const MappedFile& ref_file,
+                                const std::string& src_filename, const MappedFile& src_file,
+                                const std::string& out_filename, const ComparisonSettings& settings, std::ostream* log)
+{
+    ImageComparison comparison(ref_filename, src_filename, out_filename, settings, log);
+
+    if (comparison.decode(ref_file, src_file, true) && comparison.compare())
+    {
+        comparison.save();
+    }
+
+    return comparison.result();
+}
@@ -0,0 +1,248 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ImageWriters.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    struct FormatInfo
+    {
+        OutputFormat format;
+        const char*  name;
+        const char*  extension;
+    };
+
+    constexpr FormatInfo formats[] =
+    {
+        { OutputFormat::Png, "png", ".png" },
+        { OutputFormat::Ppm, "ppm", ".ppm" },
+        { OutputFormat::Qoi, "qoi", ".qoi" },
+        { OutputFormat::Pfm, "pfm", ".pfm" },
+        { OutputFormat::Raw, "raw", ".raw" }
+    };
+
+    void put_u32_be(std::vector<uint8_t>& out, uint32_t value)
+    {
+        out.push_back(uint8_t(value >> 24));
+        out.push_back(uint8_t(value >> 16));
+        out.push_back(uint8_t(value >> 8));
+        out.push_back(uint8_t(value));
+    }
+
+    /* Appends the values as little-endian float32 regardless of the host byte order */
+    void put_floats_le(std::vector<uint8_t>& out, const float* values, size_t count)
+    {
+        const size_t offset = out.size();
+        out.resize(offset + 4 * count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &values[i], 4);
+
+            out[offset + 4 * i + 0] = uint8_t(bits);
+            out[offset + 4 * i + 1] = uint8_t(bits >> 8);
+            out[offset + 4 * i + 2] = uint8_t(bits >> 16);
+            out[offset + 4 * i + 3] = uint8_t(bits >> 24);
+        }
+    }
+
+    bool write_all(FILE* file, const std::vector<uint8_t>& data)
+    {
+        return std::fwrite(data.data(), 1, data.size(), file) == data.size() && std::fflush(file) == 0;
+    }
+}
+
+bool output_format_from_name(const std::string& name, OutputFormat& format)
+{
+    for (const auto& info : formats)
+    {
+        if (name == info.name)
+        {
+            format = info.format;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool split_output_extension(std::string& filename, OutputFormat& format)
+{
+    for (const auto& info : formats)
+    {
+        const size_t length = std::strlen(info.extension);
+
+        if (filename.size() > length && filename.compare(filename.size() - length, length, info.extension) == 0)
+        {
+            filename.resize(filename.size() - length);
+            format = info.format;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char* output_format_extension(OutputFormat format)
+{
+    for (const auto& info : formats)
+    {
+        if (info.format == format)
+        {
+            return info.extension;
+        }
+    }
+
+    return ".png";
+}
+
+bool is_float_output_format(OutputFormat format)
+{
+    return format == OutputFormat::Pfm || format == OutputFormat::Raw;
+}
+
+bool write_ppm(FILE* file, unsigned width, unsigned height, const uint8_t* rgb)
+{
+    const size_t size = size_t(width) * height * 3;
+
+    return std::fprintf(file, "P6\n%u %u\n255\n", width, height) > 0 &&
+           std::fwrite(rgb, 1, size, file) == size &&
+           std::fflush(file) == 0;
+}
+
+bool write_qoi(FILE* file, unsigned width, unsigned height, const uint8_t* rgb)
+{
+    const size_t num_pixels = size_t(width) * height;
+
+    std::vector<uint8_t> out;
+    out.reserve(14 + num_pixels + 8);
+
+    out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+    put_u32_be(out, width);
+    put_u32_be(out, height);
+    out.push_back(3); /* RGB */
+    out.push_back(0); /* sRGB with linear alpha */
+
+    /*
+     * Index of recently seen pixels, RGBA like the decoder's. Its entries start as (0, 0, 0, 0), so they
+     * only match a pixel (always opaque here) once it has been stored
+     */
+    uint8_t index[64][4] = {};
+    uint8_t prev[3] = { 0, 0, 0 };
+    unsigned run = 0;
+
+    for (size_t i = 0; i < num_pixels; ++i)
+    {
+        const uint8_t* px = &rgb[3 * i];
+
+        if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2])
+        {
+            if (++run == 62)
+            {
+                out.push_back(uint8_t(0xC0 | (run - 1)));
+                run = 0;
+            }
+
+            continue;
+        }
+
+        if (run > 0)
+        {
+            out.push_back(uint8_t(0xC0 | (run - 1)));
+            run = 0;
+        }
+
+        const unsigned hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+
+        if (index[hash][0] == px[0] && index[hash][1] == px[1] && index[hash][2] == px[2] && index[hash][3] == 255)
+        {
+            out.push_back(uint8_t(hash));
+        }
+        else
+        {
+            std::memcpy(index[hash], px, 3);
+            index[hash][3] = 255;
+
+            const int dr = int8_t(px[0] - prev[0]);
+            const int dg = int8_t(px[1] - prev[1]);
+            const int db = int8_t(px[2] - prev[2]);
+
+            const int dr_dg = dr - dg;
+            const int db_dg = db - dg;
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+            {
+                out.push_back(uint8_t(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+            }
+            else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+            {
+                out.push_back(uint8_t(0x80 | (dg + 32)));
+                out.push_back(uint8_t((dr_dg + 8) << 4 | (db_dg + 8)));
+            }
+            else
+            {
+                out.insert(out.end(), { 0xFE, px[0], px[1], px[2] });
+            }
+        }
+
+        std::memcpy(prev, px, 3);
+    }
+
+    if (run > 0)
+    {
+        out.push_back(uint8_t(0xC0 | (run - 1)));
+    }
+
+    out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+
+    return write_all(file, out);
+}
+
+bool write_pfm(FILE* file, unsigned width, unsigned height, const float* values)
+{
+    /* A negative scale marks little-endian data */
+    const std::string header = "Pf\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+
+    std::vector<uint8_t> out(header.begin(), header.end());
+    out.reserve(header.size() + size_t(width) * height * 4);
+
+    for (size_t y = height; y-- > 0;)
+    {
+        put_floats_le(out, &values[y * width], width);
+    }
+
+    return write_all(file, out);
+}
+
+bool write_raw_float(FILE* file, unsigned width, unsigned height, const float* values)
+{
+    std::vector<uint8_t> out;
+    put_floats_le(out, values, size_t(width) * height);
+
+    return write_all(file, out);
+}
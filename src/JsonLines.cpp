@@ -0,0 +1,477 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "JsonLines.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <limits>
+
+namespace
+{
+    class JsonParser
+    {
+    public:
+        explicit JsonParser(const std::string& text) : m_text(text) {}
+
+        bool parse_object(std::map<std::string, JsonValue>& fields)
+        {
+            skip_whitespace();
+
+            if (!consume('{'))
+            {
+                return fail("expected '{'");
+            }
+
+            skip_whitespace();
+
+            if (!consume('}'))
+            {
+                do
+                {
+                    std::string key;
+                    JsonValue value;
+
+                    skip_whitespace();
+
+                    if (!parse_string(key))
+                    {
+                        return false;
+                    }
+
+                    skip_whitespace();
+
+                    if (!consume(':'))
+                    {
+                        return fail("expected ':'");
+                    }
+
+                    skip_whitespace();
+
+                    if (!parse_value(value))
+                    {
+                        return false;
+                    }
+
+                    /* Like most parsers, the last duplicate key wins */
+                    fields[key] = std::move(value);
+
+                    skip_whitespace();
+                }
+                while (consume(','));
+
+                if (!consume('}'))
+                {
+                    return fail("expected ',' or '}'");
+                }
+            }
+
+            skip_whitespace();
+
+            return m_pos == m_text.size() || fail("unexpected characters after the object");
+        }
+
+        const std::string& error() const { return m_error; }
+
+    private:
+        bool parse_value(JsonValue& value)
+        {
+            if (m_pos >= m_text.size())
+            {
+                return fail("expected a value");
+            }
+
+            const char c = m_text[m_pos];
+
+            if (c == '"')
+            {
+                value.type = JsonValue::Type::String;
+                return parse_string(value.text);
+            }
+
+            if (c == '-' || (c >= '0' && c <= '9'))
+            {
+                value.type = JsonValue::Type::Number;
+                return parse_number(value.text);
+            }
+
+            for (const char* literal : { "true", "false" })
+            {
+                if (parse_literal(literal))
+                {
+                    value.type = JsonValue::Type::Bool;
+                    value.text = literal;
+                    return true;
+                }
+            }
+
+            if (parse_literal("null"))
+            {
+                value.type = JsonValue::Type::Null;
+                return true;
+            }
+
+            if (c == '{' || c == '[')
+            {
+                return fail("nested objects and arrays aren't supported");
+            }
+
+            return fail("invalid value");
+        }
+
+        bool parse_string(std::string& out)
+        {
+            if (!consume('"'))
+            {
+                return fail("expected a string");
+            }
+
+            out.clear();
+
+            while (m_pos < m_text.size())
+            {
+                const char c = m_text[m_pos++];
+
+                if (c == '"')
+                {
+                    return true;
+                }
+
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    return fail("control character in string");
+                }
+
+                if (c != '\\')
+                {
+                    out += c;
+                    continue;
+                }
+
+                if (m_pos >= m_text.size())
+                {
+                    break;
+                }
+
+                switch (m_text[m_pos++])
+                {
+                    case '"':  out += '"';  break;
+                    case '\\': out += '\\'; break;
+                    case '/':  out += '/';  break;
+                    case 'b':  out += '\b'; break;
+                    case 'f':  out += '\f'; break;
+                    case 'n':  out += '\n'; break;
+                    case 'r':  out += '\r'; break;
+                    case 't':  out += '\t'; break;
+                    case 'u':
+                    {
+                        uint32_t code_point = 0;
+
+                        if (!parse_hex4(code_point))
+                        {
+                            return false;
+                        }
+
+                        /* A high surrogate must be followed by an escaped low surrogate */
+                        if (code_point >= 0xD800 && code_point <= 0xDBFF)
+                        {
+                            uint32_t low = 0;
+
+                            if (!consume('\\') || !consume('u') || !parse_hex4(low) || low < 0xDC00 || low > 0xDFFF)
+                            {
+                                return fail("invalid surrogate pair");
+                            }
+
+                            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        else if (code_point >= 0xDC00 && code_point <= 0xDFFF)
+                        {
+                            return fail("invalid surrogate pair");
+                        }
+
+                        append_utf8(out, code_point);
+                        break;
+                    }
+                    default:
+                        return fail("invalid escape sequence");
+                }
+            }
+
+            return fail("unterminated string");
+        }
+
+        bool parse_number(std::string& out)
+        {
+            const size_t begin = m_pos;
+
+            consume('-');
+
+            if (consume('0'))
+            {
+                /* No leading zeros */
+            }
+            else if (!consume_digits())
+            {
+                return fail("invalid number");
+            }
+
+            if (consume('.') && !consume_digits())
+            {
+                return fail("invalid number");
+            }
+
+            if (consume('e') || consume('E'))
+            {
+                if (!consume('+'))
+                {
+                    consume('-');
+                }
+
+                if (!consume_digits())
+                {
+                    return fail("invalid number");
+                }
+            }
+
+            out = m_text.substr(begin, m_pos - begin);
+
+            return true;
+        }
+
+        bool parse_hex4(uint32_t& value)
+        {
+            if (m_text.size() - m_pos < 4)
+            {
+                return fail("invalid \\u escape");
+            }
+
+            value = 0;
+
+            for (int i = 0; i < 4; ++i)
+            {
+                const char c = m_text[m_pos++];
+
+                value <<= 4;
+
+                if (c >= '0' && c <= '9')      value |= uint32_t(c - '0');
+                else if (c >= 'a' && c <= 'f') value |= uint32_t(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F') value |= uint32_t(c - 'A' + 10);
+                else return fail("invalid \\u escape");
+            }
+
+            return true;
+        }
+
+        bool parse_literal(const char* literal)
+        {
+            const std::string word(literal);
+
+            if (m_text.compare(m_pos, word.size(), word) != 0)
+            {
+                return false;
+            }
+
+            m_pos += word.size();
+
+            return true;
+        }
+
+        bool consume_digits()
+        {
+            const size_t begin = m_pos;
+
+            while (m_pos < m_text.size() && m_text[m_pos] >= '0' && m_text[m_pos] <= '9')
+            {
+                ++m_pos;
+            }
+
+            return m_pos > begin;
+        }
+
+        bool consume(char c)
+        {
+            if (m_pos < m_text.size() && m_text[m_pos] == c)
+            {
+                ++m_pos;
+                return true;
+            }
+
+            return false;
+        }
+
+        void skip_whitespace()
+        {
+            while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+            {
+                ++m_pos;
+            }
+        }
+
+        bool fail(const std::string& message)
+        {
+            if (m_error.empty())
+            {
+                m_error = message + " at column " + std::to_string(m_pos + 1);
+            }
+
+            return false;
+        }
+
+        static void append_utf8(std::string& out, uint32_t code_point)
+        {
+            if (code_point < 0x80)
+            {
+                out += char(code_point);
+            }
+            else if (code_point < 0x800)
+            {
+                out += char(0xC0 | (code_point >> 6));
+                out += char(0x80 | (code_point & 0x3F));
+            }
+            else if (code_point < 0x10000)
+            {
+                out += char(0xE0 | (code_point >> 12));
+                out += char(0x80 | ((code_point >> 6) & 0x3F));
+                out += char(0x80 | (code_point & 0x3F));
+            }
+            else
+            {
+                out += char(0xF0 | (code_point >> 18));
+                out += char(0x80 | ((code_point >> 12) & 0x3F));
+                out += char(0x80 | ((code_point >> 6) & 0x3F));
+                out += char(0x80 | (code_point & 0x3F));
+            }
+        }
+
+        const std::string& m_text;
+        size_t m_pos = 0;
+        std::string m_error;
+    };
+}
+
+bool parse_json_object(const std::string& text, std::map<std::string, JsonValue>& fields, std::string& error)
+{
+    JsonParser parser(text);
+
+    if (!parser.parse_object(fields))
+    {
+        error = parser.error();
+        return false;
+    }
+
+    return true;
+}
+
+std::string json_quote(const std::string& value)
+{
+    std::string out = "\"";
+
+    for (const char c : value)
+    {
+        switch (c)
+        {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b";  break;
+            case '\f': out += "\\f";  break;
+            case '\n': out += "\\n";  break;
+            case '\r': out += "\\r";  break;
+            case '\t': out += "\\t";  break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", unsigned(c));
+                    out += escaped;
+                }
+                else
+                {
+                    /* UTF-8 sequences are copied as they are */
+                    out += c;
+                }
+        }
+    }
+
+    return out + "\"";
+}
+
+JsonObjectWriter& JsonObjectWriter::add_string(const std::string& key, const std::string& value)
+{
+    add_key(key);
+    m_body += json_quote(value);
+
+    return *this;
+}
+
+JsonObjectWriter& JsonObjectWriter::add_integer(const std::string& key, int64_t value)
+{
+    add_key(key);
+    m_body += std::to_string(value);
+
+    return *this;
+}
+
+JsonObjectWriter& JsonObjectWriter::add_bool(const std::string& key, bool value)
+{
+    add_key(key);
+    m_body += value ? "true" : "false";
+
+    return *this;
+}
+
+JsonObjectWriter& JsonObjectWriter::add_number(const std::string& key, double value)
+{
+    add_key(key);
+
+    if (!std::isfinite(value))
+    {
+        m_body += "null";
+        return *this;
+    }
+
+    /* The shortest of 15 or 17 significant digits that reads back as the same value */
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.15g", value);
+
+    if (std::strtod(number, nullptr) != value)
+    {
+        std::snprintf(number, sizeof(number), "%.*g", std::numeric_limits<double>::max_digits10, value);
+    }
+
+    m_body += number;
+
+    return *this;
+}
+
+void JsonObjectWriter::add_key(const std::string& key)
+{
+    if (!m_body.empty())
+    {
+        m_body += ",";
+    }
+
+    m_body += json_quote(key) + ":";
+}
@@ -24,52 +24,233 @@ SOFTWARE.
 
 #include "LabComparator.hpp"
 
-LabComparator::LabComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges)
-    : BaseComparator(colormap_type, out_filename, width, height, interpolation_ranges),
-      m_delta_e     (0.0)
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <ostream>
+
+#include "ColorConversion.hpp"
+#include "ThreadPool.hpp"
+
+template<typename T>
+LabComparator<T>::LabComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges,
+                                PaletteCacheMode palette_cache_mode)
+    : BaseComparator         (colormap_type, out_filename, width, height, interpolation_ranges),
+      m_delta_e              (0.0),
+      m_delta_e_image        (size_t(width) * height),
+      m_min_error            (0),
+      m_max_error            (0),
+      m_palette_cache_mode   (palette_cache_mode),
+      m_palette_cache_used   (false),
+      m_palette_cache_hits   (0),
+      m_palette_cache_lookups(0)
+{
+}
+
+template<typename T>
+LabComparator<T>::~LabComparator()
+{
+}
+
+template<typename T>
+void LabComparator<T>::compare(const ImageView& ref_img, const ImageView& src_image)
 {
+    /* The cache is keyed on 8-bit RGB */
+    m_palette_cache_used = ref_img.bit_depth() == 8 &&
+                           (m_palette_cache_mode == PaletteCacheMode::On ||
+                           (m_palette_cache_mode == PaletteCacheMode::Auto && LabPaletteCache<T>::is_low_palette(ref_img, src_image)));
+
+    compare_pixels(src_image, [&ref_img](size_t i, T* lab, auto&& pixel_to_lab) { pixel_to_lab(ref_img, i, lab); });
 }
 
-LabComparator::~LabComparator()
+template<typename T>
+std::shared_ptr<const PreparedReference> LabComparator<T>::prepare_reference(const ImageView& ref_img) const
 {
+    auto reference = std::make_shared<Reference>();
+
+    /* rgb_to_lab() is what the palette cache stores as well, so the values match compare()'s exactly */
+    reference->lab = rgb_2_lab<T>(ref_img);
+
+    if (ref_img.bit_depth() == 8)
+    {
+        reference->palette_sample = LabPaletteCache<T>::sample_colors(ref_img);
+    }
+
+    return reference;
 }
 
-void LabComparator::compare(const std::vector<uint8_t>& ref_img, const std::vector<uint8_t>& src_image)
+template<typename T>
+void LabComparator<T>::compare(const PreparedReference& ref, const ImageView& src_image)
 {
-    /* Convert RGB to L*a*b* */
-    auto ref_lab = rgb_2_lab(ref_img);
-    auto src_lab = rgb_2_lab(src_image);
+    const Reference& reference = static_cast<const Reference&>(ref);
+    const std::vector<T>& ref_lab = reference.lab;
+
+    /* Only the source is converted, but Auto decides on both images like compare() does */
+    m_palette_cache_used = src_image.bit_depth() == 8 &&
+                           (m_palette_cache_mode == PaletteCacheMode::On ||
+                           (m_palette_cache_mode == PaletteCacheMode::Auto &&
+                            LabPaletteCache<T>::is_low_palette(reference.palette_sample, LabPaletteCache<T>::sample_colors(src_image))));
+
+    compare_pixels(src_image, [&ref_lab](size_t i, T* lab, auto&&)
+    {
+        lab[0] = ref_lab[3 * i];
+        lab[1] = ref_lab[3 * i + 1];
+        lab[2] = ref_lab[3 * i + 2];
+    });
+}
+
+template<typename T>
+template<typename RefToLab>
+void LabComparator<T>::compare_pixels(const ImageView& src_image, RefToLab&& ref_to_lab)
+{
+    const size_t num_pixels = src_image.size() / (3 * src_image.bytes_per_channel());
+    const size_t tiles      = num_tiles(num_pixels);
+
+    auto& pool = ThreadPool::global();
+
+    struct TileError
+    {
+        double sum     = 0.0;
+        T      min_err = std::numeric_limits<T>::max();
+        T      max_err = std::numeric_limits<T>::lowest();
+    };
+
+    std::vector<TileError> tile_errors(tiles);
+
+    std::vector<T>& delta_e_image = m_delta_e_image;
+    delta_e_image.resize(num_pixels);
+
+    /* Caches are per comparison so the statistics only cover this pair */
+    m_caches.clear();
+
+    /* Single pass: convert both pixels to L*a*b*, compute delta E and track its sum and range per tile */
+    auto compare_tile = [&](size_t tile, auto&& pixel_to_lab)
+    {
+        T ref_lab_pixel[3];
+        T src_lab_pixel[3];
+
+        TileError error;
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t i = tile * tile_size; i < end; ++i)
+        {
+            ref_to_lab(i, ref_lab_pixel, pixel_to_lab);
+            pixel_to_lab(src_image, i, src_lab_pixel);
+
+            /* 
+             * Calculate delta E based on https://sensing.konicaminolta.us/us/blog/identifying-color-differences-using-l-a-b-or-l-c-h-coordinates/ 
+             */
+            T err = std::sqrt((src_lab_pixel[0] - ref_lab_pixel[0]) * (src_lab_pixel[0] - ref_lab_pixel[0]) + 
+                              (src_lab_pixel[1] - ref_lab_pixel[1]) * (src_lab_pixel[1] - ref_lab_pixel[1]) +
+                              (src_lab_pixel[2] - ref_lab_pixel[2]) * (src_lab_pixel[2] - ref_lab_pixel[2]));
+            error.sum += err;
+            delta_e_image[i] = err;
 
-    unsigned num_pixels = ref_lab.size() / 3;
-    std::vector<double>  delta_e_image(num_pixels);
+            error.min_err = std::min(error.min_err, err);
+            error.max_err = std::max(error.max_err, err);
+        }
 
-    std::array<double, 3> ref_lab_pixel;
-    std::array<double, 3> src_lab_pixel;
+        tile_errors[tile] = error;
+    };
+
+    const T* table16 = src_image.bit_depth() > 8 ? color::srgb16_to_linear_table<T>() : nullptr;
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        if (table16)
+        {
+            compare_tile(tile, [table16](const ImageView& img, size_t i, T* lab) { color::rgb_to_lab(img.data16() + 3 * i, lab, table16); });
+        }
+        else if (m_palette_cache_used)
+        {
+            auto cache = acquire_cache();
+            compare_tile(tile, [&](const ImageView& img, size_t i, T* lab) { cache->convert(&img[3 * i], lab); });
+            release_cache(std::move(cache));
+        }
+        else
+        {
+            compare_tile(tile, [](const ImageView& img, size_t i, T* lab) { color::rgb_to_lab(&img[3 * i], lab); });
+        }
+    });
+
+    m_palette_cache_hits    = 0;
+    m_palette_cache_lookups = 0;
+
+    for (const auto& cache : m_caches)
+    {
+        m_palette_cache_hits    += cache->hits();
+        m_palette_cache_lookups += cache->hits() + cache->misses();
+    }
+
+    /* Tile sums are combined in tile order so the result doesn't depend on scheduling */
+    T min_err = std::numeric_limits<T>::max();
+    T max_err = std::numeric_limits<T>::lowest();
 
     m_delta_e = 0.0;
 
-    for (unsigned i = 0; i < delta_e_image.size(); ++i)
+    for (const auto& error : tile_errors)
     {
-        ref_lab_pixel = { ref_lab[3 * i + 0], ref_lab[3 * i + 1], ref_lab[3 * i + 2] };
-        src_lab_pixel = { src_lab[3 * i + 0], src_lab[3 * i + 1], src_lab[3 * i + 2] };
-
-        /* 
-         * Calculate delta E based on https://sensing.konicaminolta.us/us/blog/identifying-color-differences-using-l-a-b-or-l-c-h-coordinates/ 
-         */
-        double err = std::sqrt((src_lab_pixel[0] - ref_lab_pixel[0]) * (src_lab_pixel[0] - ref_lab_pixel[0]) + 
-                               (src_lab_pixel[1] - ref_lab_pixel[1]) * (src_lab_pixel[1] - ref_lab_pixel[1]) +
-                               (src_lab_pixel[2] - ref_lab_pixel[2]) * (src_lab_pixel[2] - ref_lab_pixel[2]));
-        m_delta_e += err;
-        delta_e_image[i] = err;
+        m_delta_e += error.sum;
+        min_err    = std::min(min_err, error.min_err);
+        max_err    = std::max(max_err, error.max_err);
     }
 
     m_delta_e /= num_pixels;
 
-    auto delta_e_image_norm = normalize_image_linear(delta_e_image, 0.0, 1.0);
-    save_diff_image(delta_e_image_norm);
+    m_min_error = min_err;
+    m_max_error = max_err;
 }
 
-double LabComparator::get_error() const
+template<typename T>
+bool LabComparator<T>::save()
+{
+    /* Normalization to [0, 1] happens while writing, the range is already known */
+    return save_diff_image(m_delta_e_image, m_min_error, m_max_error);
+}
+
+template<typename T>
+double LabComparator<T>::get_error() const
 {
     return m_delta_e;
 }
+
+template<typename T>
+void LabComparator<T>::print_stats(std::ostream& out) const
+{
+    if (!m_palette_cache_used)
+    {
+        out << "Palette cache: off" << std::endl;
+        return;
+    }
+
+    const double hit_rate = m_palette_cache_lookups > 0 ? 100.0 * m_palette_cache_hits / m_palette_cache_lookups : 0.0;
+
+    out << "Palette cache: " << hit_rate << "% hit rate, "
+        << (m_palette_cache_lookups - m_palette_cache_hits) << " conversions for " << m_palette_cache_lookups << " lookups" << std::endl;
+}
+
+template<typename T>
+std::unique_ptr<LabPaletteCache<T>> LabComparator<T>::acquire_cache()
+{
+    std::lock_guard<std::mutex> lock(m_caches_mutex);
+
+    if (m_caches.empty())
+    {
+        return std::make_unique<LabPaletteCache<T>>();
+    }
+
+    auto cache = std::move(m_caches.back());
+    m_caches.pop_back();
+
+    return cache;
+}
+
+template<typename T>
+void LabComparator<T>::release_cache(std::unique_ptr<LabPaletteCache<T>> cache)
+{
+    std::lock_guard<std::mutex> lock(m_caches_mutex);
+    m_caches.push_back(std::move(cache));
+}
+
+template class LabComparator<float>;
+template class LabComparator<double>;
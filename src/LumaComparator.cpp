@@ -24,49 +24,286 @@ SOFTWARE.
 
 #include "LumaComparator.hpp"
 
-LumaComparator::LumaComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges)
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include "LumaKernels.hpp"
+#include "ThreadPool.hpp"
+
+template<typename T>
+LumaComparator<T>::LumaComparator(const tinycolormap::ColormapType& colormap_type, const std::string& out_filename, unsigned width, unsigned height, int interpolation_ranges)
     : BaseComparator(colormap_type, out_filename, width, height, interpolation_ranges),
-      m_mse         (0.0)
+      m_mse         (0.0),
+      m_mse_image   (size_t(width) * height),
+      m_min_error   (0),
+      m_max_error   (0)
 {
 }
 
-LumaComparator::~LumaComparator()
+template<typename T>
+LumaComparator<T>::~LumaComparator()
 {
 }
 
-void LumaComparator::compare(const std::vector<uint8_t>& ref_img, const std::vector<uint8_t>& src_image)
+template<typename T>
+void LumaComparator<T>::compare(const ImageView& ref_img, const ImageView& src_image)
 {
-    /* Calculate luminance of both images */
-    auto ref_luma = luma(ref_img);
-    auto src_luma = luma(src_image);
+    /* Luma is recomputed per chunk into small buffers instead of being stored for the whole image */
+    constexpr size_t chunk_size = 1024;
 
-    /* Normalize both images */
-    auto ref_norm_luma = normalize_image_linear(ref_luma, 0.0, 1.0);
-    auto src_norm_luma = normalize_image_linear(src_luma, 0.0, 1.0);
+    const auto luma_kernel = select_luma_kernel<T>();
+    const size_t num_pixels = ref_img.size() / (3 * ref_img.bytes_per_channel());
+    const size_t tiles      = num_tiles(num_pixels);
 
-    unsigned num_pixels = ref_luma.size();
-    std::vector<double>  mse_image(num_pixels);
+    auto& pool = ThreadPool::global();
 
-    m_mse = 0.0;
+    /* Pass 1: luminance range of both images */
+    struct LumaRange
+    {
+        T ref_min = std::numeric_limits<T>::max(), ref_max = std::numeric_limits<T>::lowest();
+        T src_min = std::numeric_limits<T>::max(), src_max = std::numeric_limits<T>::lowest();
+    };
+
+    std::vector<LumaRange> tile_ranges(tiles);
 
-    for (unsigned i = 0; i < mse_image.size(); ++i)
+    pool.parallel_for(tiles, [&](size_t tile)
     {
-        /* Calculate MSE */
-        double err = ref_norm_luma[i] - src_norm_luma[i];
+        std::array<T, chunk_size> ref_luma;
+        std::array<T, chunk_size> src_luma;
+
+        LumaRange range;
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
 
-        err    = err * err;
-        m_mse += err;
+        for (size_t offset = tile * tile_size; offset < end; offset += chunk_size)
+        {
+            const size_t count = std::min(chunk_size, end - offset);
 
-        mse_image[i] = err;
+            compute_luma(ref_img,   luma_kernel, offset, ref_luma.data(), count);
+            compute_luma(src_image, luma_kernel, offset, src_luma.data(), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                range.ref_min = std::min(range.ref_min, ref_luma[i]);
+                range.ref_max = std::max(range.ref_max, ref_luma[i]);
+                range.src_min = std::min(range.src_min, src_luma[i]);
+                range.src_max = std::max(range.src_max, src_luma[i]);
+            }
+        }
+
+        tile_ranges[tile] = range;
+    });
+
+    LumaRange range;
+
+    for (const auto& tile_range : tile_ranges)
+    {
+        range.ref_min = std::min(range.ref_min, tile_range.ref_min);
+        range.ref_max = std::max(range.ref_max, tile_range.ref_max);
+        range.src_min = std::min(range.src_min, tile_range.src_min);
+        range.src_max = std::max(range.src_max, tile_range.src_max);
+    }
+
+    /* Linear normalization of each image to the range [0, 1] */
+    const T ref_ratio = T(1) / (range.ref_max - range.ref_min > T(0) ? range.ref_max - range.ref_min : T(1));
+    const T src_ratio = T(1) / (range.src_max - range.src_min > T(0) ? range.src_max - range.src_min : T(1));
+
+    /* Pass 2: normalize, diff, square, accumulate MSE and track the error range */
+    std::vector<TileError> tile_errors(tiles);
+
+    std::vector<T>& mse_image = m_mse_image;
+    mse_image.resize(num_pixels);
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        std::array<T, chunk_size> ref_luma;
+        std::array<T, chunk_size> src_luma;
+
+        TileError error;
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t offset = tile * tile_size; offset < end; offset += chunk_size)
+        {
+            const size_t count = std::min(chunk_size, end - offset);
+
+            compute_luma(ref_img,   luma_kernel, offset, ref_luma.data(), count);
+            compute_luma(src_image, luma_kernel, offset, src_luma.data(), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                /* Calculate MSE */
+                T err = (ref_luma[i] - range.ref_min) * ref_ratio - (src_luma[i] - range.src_min) * src_ratio;
+
+                err        = err * err;
+                error.sum += err;
+
+                mse_image[offset + i] = err;
+
+                error.min_err = std::min(error.min_err, err);
+                error.max_err = std::max(error.max_err, err);
+            }
+        }
+
+        tile_errors[tile] = error;
+    });
+
+    reduce_tile_errors(tile_errors, num_pixels);
+}
+
+template<typename T>
+std::shared_ptr<const PreparedReference> LumaComparator<T>::prepare_reference(const ImageView& ref_img) const
+{
+    const size_t num_pixels = ref_img.size() / (3 * ref_img.bytes_per_channel());
+    const size_t tiles      = num_tiles(num_pixels);
+
+    auto reference = std::make_shared<Reference>();
+    std::vector<T>& luma = reference->luma;
+
+    /* Unlike compare(), the whole plane is kept, it is read once per source */
+    luma = BaseComparator::luma<T>(ref_img);
+
+    const auto [ref_min, ref_max] = image_min_max(luma);
+
+    /* The same expression as in compare(), so both paths give identical results */
+    const T ref_ratio = T(1) / (ref_max - ref_min > T(0) ? ref_max - ref_min : T(1));
+
+    ThreadPool::global().parallel_for(tiles, [&](size_t tile)
+    {
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t i = tile * tile_size; i < end; ++i)
+        {
+            luma[i] = (luma[i] - ref_min) * ref_ratio;
+        }
+    });
+
+    return reference;
+}
+
+template<typename T>
+void LumaComparator<T>::compare(const PreparedReference& ref, const ImageView& src_image)
+{
+    constexpr size_t chunk_size = 1024;
+
+    const std::vector<T>& ref_luma = static_cast<const Reference&>(ref).luma;
+
+    const auto luma_kernel = select_luma_kernel<T>();
+    const size_t num_pixels = src_image.size() / (3 * src_image.bytes_per_channel());
+    const size_t tiles      = num_tiles(num_pixels);
+
+    auto& pool = ThreadPool::global();
+
+    /* Pass 1: luminance range of the source */
+    std::vector<std::pair<T, T>> tile_ranges(tiles);
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        std::array<T, chunk_size> src_luma;
+
+        T src_min = std::numeric_limits<T>::max();
+        T src_max = std::numeric_limits<T>::lowest();
+
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t offset = tile * tile_size; offset < end; offset += chunk_size)
+        {
+            const size_t count = std::min(chunk_size, end - offset);
+
+            compute_luma(src_image, luma_kernel, offset, src_luma.data(), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                src_min = std::min(src_min, src_luma[i]);
+                src_max = std::max(src_max, src_luma[i]);
+            }
+        }
+
+        tile_ranges[tile] = { src_min, src_max };
+    });
+
+    T src_min = std::numeric_limits<T>::max();
+    T src_max = std::numeric_limits<T>::lowest();
+
+    for (const auto& tile_range : tile_ranges)
+    {
+        src_min = std::min(src_min, tile_range.first);
+        src_max = std::max(src_max, tile_range.second);
+    }
+
+    const T src_ratio = T(1) / (src_max - src_min > T(0) ? src_max - src_min : T(1));
+
+    /* Pass 2: normalize the source and diff it with the normalized reference */
+    std::vector<TileError> tile_errors(tiles);
+
+    std::vector<T>& mse_image = m_mse_image;
+    mse_image.resize(num_pixels);
+
+    pool.parallel_for(tiles, [&](size_t tile)
+    {
+        std::array<T, chunk_size> src_luma;
+
+        TileError error;
+        const size_t end = std::min(num_pixels, (tile + 1) * tile_size);
+
+        for (size_t offset = tile * tile_size; offset < end; offset += chunk_size)
+        {
+            const size_t count = std::min(chunk_size, end - offset);
+
+            compute_luma(src_image, luma_kernel, offset, src_luma.data(), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                T err = ref_luma[offset + i] - (src_luma[i] - src_min) * src_ratio;
+
+                err        = err * err;
+                error.sum += err;
+
+                mse_image[offset + i] = err;
+
+                error.min_err = std::min(error.min_err, err);
+                error.max_err = std::max(error.max_err, err);
+            }
+        }
+
+        tile_errors[tile] = error;
+    });
+
+    reduce_tile_errors(tile_errors, num_pixels);
+}
+
+template<typename T>
+void LumaComparator<T>::reduce_tile_errors(const std::vector<TileError>& tile_errors, size_t num_pixels)
+{
+    T min_err = std::numeric_limits<T>::max();
+    T max_err = std::numeric_limits<T>::lowest();
+
+    m_mse = 0.0;
+
+    for (const auto& error : tile_errors)
+    {
+        m_mse  += error.sum;
+        min_err = std::min(min_err, error.min_err);
+        max_err = std::max(max_err, error.max_err);
     }
 
     m_mse /= num_pixels;
 
-    auto mse_image_norm = normalize_image_linear(mse_image, 0.0, 1.0);
-    save_diff_image(mse_image_norm);
+    m_min_error = min_err;
+    m_max_error = max_err;
 }
 
-double LumaComparator::get_error() const
+template<typename T>
+bool LumaComparator<T>::save()
+{
+    /* Normalization to [0, 1] happens while writing, the range is already known */
+    return save_diff_image(m_mse_image, m_min_error, m_max_error);
+}
+
+template<typename T>
+double LumaComparator<T>::get_error() const
 {
     return m_mse;
 }
+
+template class LumaComparator<float>;
+template class LumaComparator<double>;
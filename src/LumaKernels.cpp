@@ -0,0 +1,106 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "LumaKernels.hpp"
+
+void luma_kernel_scalar(const uint8_t* rgb, double* luma, size_t num_pixels)
+{
+    for (size_t i = 0; i < num_pixels; ++i)
+    {
+        /* Conver to [0, 1] range */
+        double r = rgb[3 * i + 0] / 255.0;
+        double g = rgb[3 * i + 1] / 255.0;
+        double b = rgb[3 * i + 2] / 255.0;
+
+        /* Calculate luminance */
+        luma[i] = r * 0.2126 + g * 0.7152 + b * 0.0722;
+    }
+}
+
+void luma_kernel_scalar(const uint8_t* rgb, float* luma, size_t num_pixels)
+{
+    for (size_t i = 0; i < num_pixels; ++i)
+    {
+        float r = rgb[3 * i + 0] / 255.0f;
+        float g = rgb[3 * i + 1] / 255.0f;
+        float b = rgb[3 * i + 2] / 255.0f;
+
+        luma[i] = r * 0.2126f + g * 0.7152f + b * 0.0722f;
+    }
+}
+
+void luma_kernel_scalar(const uint8_t* rgb, uint32_t* luma, size_t num_pixels)
+{
+    for (size_t i = 0; i < num_pixels; ++i)
+    {
+        luma[i] = 2126u * rgb[3 * i + 0] + 7152u * rgb[3 * i + 1] + 722u * rgb[3 * i + 2];
+    }
+}
+
+void luma_kernel16(const uint16_t* rgb, double* luma, size_t num_pixels)
+{
+    for (size_t i = 0; i < num_pixels; ++i)
+    {
+        double r = rgb[3 * i + 0] / 65535.0;
+        double g = rgb[3 * i + 1] / 65535.0;
+        double b = rgb[3 * i + 2] / 65535.0;
+
+        luma[i] = r * 0.2126 + g * 0.7152 + b * 0.0722;
+    }
+}
+
+void luma_kernel16(const uint16_t* rgb, float* luma, size_t num_pixels)
+{
+    for (size_t i = 0; i < num_pixels; ++i)
+    {
+        float r = rgb[3 * i + 0] / 65535.0f;
+        float g = rgb[3 * i + 1] / 65535.0f;
+        float b = rgb[3 * i + 2] / 65535.0f;
+
+        luma[i] = r * 0.2126f + g * 0.7152f + b * 0.0722f;
+    }
+}
+
+template<typename T>
+LumaKernel<T> select_luma_kernel()
+{
+    static const LumaKernel<T> kernel = []() -> LumaKernel<T>
+    {
+        switch (detect_simd_level())
+        {
+#ifdef COLORIMGDIFF_X86
+            case SimdLevel::AVX512: return luma_kernel_avx512;
+            case SimdLevel::AVX2:   return luma_kernel_avx2;
+            case SimdLevel::SSE41:  return luma_kernel_sse41;
+#endif
+            default:                return luma_kernel_scalar;
+        }
+    }();
+
+    return kernel;
+}
+
+template LumaKernel<float>    select_luma_kernel<float>();
+template LumaKernel<double>   select_luma_kernel<double>();
+template LumaKernel<uint32_t> select_luma_kernel<uint32_t>();
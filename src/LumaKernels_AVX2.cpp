@@ -0,0 +1,110 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "LumaKernels.hpp"
+
+#ifdef COLORIMGDIFF_X86
+
+#include <immintrin.h>
+
+namespace
+{
+    /* Deinterleaves 8 pixels into 32-bit R, G and B lanes. Reads 28 bytes. */
+    inline void load_rgb8(const uint8_t* p, __m256i& r, __m256i& g, __m256i& b)
+    {
+        /* Gathers 4 interleaved pixels into [R0..R3 G0..G3 B0..B3 - - - -] */
+        const __m128i deinterleave = _mm_setr_epi8(0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, -1, -1, -1, -1);
+
+        const __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)),      deinterleave);
+        const __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), deinterleave);
+
+        /* [R0..R7 G0..G7] and [B0..B7 - -] */
+        const __m128i rg = _mm_unpacklo_epi32(lo, hi);
+        const __m128i bx = _mm_unpackhi_epi32(lo, hi);
+
+        r = _mm256_cvtepu8_epi32(rg);
+        g = _mm256_cvtepu8_epi32(_mm_srli_si128(rg, 8));
+        b = _mm256_cvtepu8_epi32(bx);
+    }
+}
+
+void luma_kernel_avx2(const uint8_t* rgb, double* luma, size_t num_pixels)
+{
+    const __m256d wr = _mm256_set1_pd(0.2126 / 255.0);
+    const __m256d wg = _mm256_set1_pd(0.7152 / 255.0);
+    const __m256d wb = _mm256_set1_pd(0.0722 / 255.0);
+
+    run_luma_blocks<8>(rgb, luma, num_pixels, [&](const uint8_t* p, double* y)
+    {
+        __m256i r32, g32, b32;
+        load_rgb8(p, r32, g32, b32);
+
+        __m256d y_lo = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(r32)), wr);
+        y_lo = _mm256_fmadd_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(g32)), wg, y_lo);
+        y_lo = _mm256_fmadd_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(b32)), wb, y_lo);
+
+        __m256d y_hi = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(r32, 1)), wr);
+        y_hi = _mm256_fmadd_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(g32, 1)), wg, y_hi);
+        y_hi = _mm256_fmadd_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(b32, 1)), wb, y_hi);
+
+        _mm256_storeu_pd(y + 0, y_lo);
+        _mm256_storeu_pd(y + 4, y_hi);
+    });
+}
+
+void luma_kernel_avx2(const uint8_t* rgb, float* luma, size_t num_pixels)
+{
+    const __m256 wr = _mm256_set1_ps(0.2126f / 255.0f);
+    const __m256 wg = _mm256_set1_ps(0.7152f / 255.0f);
+    const __m256 wb = _mm256_set1_ps(0.0722f / 255.0f);
+
+    run_luma_blocks<8>(rgb, luma, num_pixels, [&](const uint8_t* p, float* y)
+    {
+        __m256i r32, g32, b32;
+        load_rgb8(p, r32, g32, b32);
+
+        __m256 y8 = _mm256_mul_ps(_mm256_cvtepi32_ps(r32), wr);
+        y8 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(g32), wg, y8);
+        y8 = _mm256_fmadd_ps(_mm256_cvtepi32_ps(b32), wb, y8);
+
+        _mm256_storeu_ps(y, y8);
+    });
+}
+
+void luma_kernel_avx2(const uint8_t* rgb, uint32_t* luma, size_t num_pixels)
+{
+    const __m256i wr = _mm256_set1_epi32(2126);
+    const __m256i wg = _mm256_set1_epi32(7152);
+    const __m256i wb = _mm256_set1_epi32(722);
+
+    run_luma_blocks<8>(rgb, luma, num_pixels, [&](const uint8_t* p, uint32_t* y)
+    {
+        __m256i r32, g32, b32;
+        load_rgb8(p, r32, g32, b32);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y), _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(r32, wr), _mm256_mullo_epi32(g32, wg)), _mm256_mullo_epi32(b32, wb)));
+    });
+}
+
+#endif
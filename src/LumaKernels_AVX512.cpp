@@ -0,0 +1,114 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "LumaKernels.hpp"
+
+#ifdef COLORIMGDIFF_X86
+
+#include <immintrin.h>
+
+namespace
+{
+    /* Deinterleaves 16 pixels into 32-bit R, G and B lanes. Reads 52 bytes. */
+    inline void load_rgb16(const uint8_t* p, __m512i& r32, __m512i& g32, __m512i& b32)
+    {
+        /* Gathers 4 interleaved pixels into [R0..R3 G0..G3 B0..B3 - - - -] */
+        const __m128i deinterleave = _mm_setr_epi8(0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, -1, -1, -1, -1);
+
+        const __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p +  0)), deinterleave);
+        const __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), deinterleave);
+        const __m128i c = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 24)), deinterleave);
+        const __m128i d = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 36)), deinterleave);
+
+        /* [R0..R7 G0..G7], [R8..R15 G8..G15], [B0..B7 - -], [B8..B15 - -] */
+        const __m128i rg_lo = _mm_unpacklo_epi32(a, b);
+        const __m128i rg_hi = _mm_unpacklo_epi32(c, d);
+        const __m128i bx_lo = _mm_unpackhi_epi32(a, b);
+        const __m128i bx_hi = _mm_unpackhi_epi32(c, d);
+
+        r32 = _mm512_cvtepu8_epi32(_mm_unpacklo_epi64(rg_lo, rg_hi));
+        g32 = _mm512_cvtepu8_epi32(_mm_unpackhi_epi64(rg_lo, rg_hi));
+        b32 = _mm512_cvtepu8_epi32(_mm_unpacklo_epi64(bx_lo, bx_hi));
+    }
+}
+
+void luma_kernel_avx512(const uint8_t* rgb, double* luma, size_t num_pixels)
+{
+    const __m512d wr = _mm512_set1_pd(0.2126 / 255.0);
+    const __m512d wg = _mm512_set1_pd(0.7152 / 255.0);
+    const __m512d wb = _mm512_set1_pd(0.0722 / 255.0);
+
+    run_luma_blocks<16>(rgb, luma, num_pixels, [&](const uint8_t* p, double* y)
+    {
+        __m512i r32, g32, b32;
+        load_rgb16(p, r32, g32, b32);
+
+        __m512d y_lo = _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(r32)), wr);
+        y_lo = _mm512_fmadd_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(g32)), wg, y_lo);
+        y_lo = _mm512_fmadd_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(b32)), wb, y_lo);
+
+        __m512d y_hi = _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(r32, 1)), wr);
+        y_hi = _mm512_fmadd_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(g32, 1)), wg, y_hi);
+        y_hi = _mm512_fmadd_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(b32, 1)), wb, y_hi);
+
+        _mm512_storeu_pd(y + 0, y_lo);
+        _mm512_storeu_pd(y + 8, y_hi);
+    });
+}
+
+void luma_kernel_avx512(const uint8_t* rgb, float* luma, size_t num_pixels)
+{
+    const __m512 wr = _mm512_set1_ps(0.2126f / 255.0f);
+    const __m512 wg = _mm512_set1_ps(0.7152f / 255.0f);
+    const __m512 wb = _mm512_set1_ps(0.0722f / 255.0f);
+
+    run_luma_blocks<16>(rgb, luma, num_pixels, [&](const uint8_t* p, float* y)
+    {
+        __m512i r32, g32, b32;
+        load_rgb16(p, r32, g32, b32);
+
+        __m512 y16 = _mm512_mul_ps(_mm512_cvtepi32_ps(r32), wr);
+        y16 = _mm512_fmadd_ps(_mm512_cvtepi32_ps(g32), wg, y16);
+        y16 = _mm512_fmadd_ps(_mm512_cvtepi32_ps(b32), wb, y16);
+
+        _mm512_storeu_ps(y, y16);
+    });
+}
+
+void luma_kernel_avx512(const uint8_t* rgb, uint32_t* luma, size_t num_pixels)
+{
+    const __m512i wr = _mm512_set1_epi32(2126);
+    const __m512i wg = _mm512_set1_epi32(7152);
+    const __m512i wb = _mm512_set1_epi32(722);
+
+    run_luma_blocks<16>(rgb, luma, num_pixels, [&](const uint8_t* p, uint32_t* y)
+    {
+        __m512i r32, g32, b32;
+        load_rgb16(p, r32, g32, b32);
+
+        _mm512_storeu_si512(y, _mm512_add_epi32(_mm512_add_epi32(_mm512_mullo_epi32(r32, wr), _mm512_mullo_epi32(g32, wg)), _mm512_mullo_epi32(b32, wb)));
+    });
+}
+
+#endif
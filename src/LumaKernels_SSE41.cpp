@@ -0,0 +1,102 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "LumaKernels.hpp"
+
+#ifdef COLORIMGDIFF_X86
+
+#include <smmintrin.h>
+
+namespace
+{
+    /* Deinterleaves 4 pixels into 32-bit R, G and B lanes. Reads 16 bytes. */
+    inline void load_rgb4(const uint8_t* p, __m128i& r, __m128i& g, __m128i& b)
+    {
+        /* Gathers 4 interleaved pixels into [R0..R3 G0..G3 B0..B3 - - - -] */
+        const __m128i deinterleave = _mm_setr_epi8(0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, -1, -1, -1, -1);
+        const __m128i px = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), deinterleave);
+
+        r = _mm_cvtepu8_epi32(px);
+        g = _mm_cvtepu8_epi32(_mm_srli_si128(px, 4));
+        b = _mm_cvtepu8_epi32(_mm_srli_si128(px, 8));
+    }
+}
+
+void luma_kernel_sse41(const uint8_t* rgb, double* luma, size_t num_pixels)
+{
+    const __m128d wr = _mm_set1_pd(0.2126 / 255.0);
+    const __m128d wg = _mm_set1_pd(0.7152 / 255.0);
+    const __m128d wb = _mm_set1_pd(0.0722 / 255.0);
+
+    run_luma_blocks<4>(rgb, luma, num_pixels, [&](const uint8_t* p, double* y)
+    {
+        __m128i r, g, b;
+        load_rgb4(p, r, g, b);
+
+        const __m128d y_lo = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(r), wr),
+                                                   _mm_mul_pd(_mm_cvtepi32_pd(g), wg)),
+                                                   _mm_mul_pd(_mm_cvtepi32_pd(b), wb));
+
+        const __m128d y_hi = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(r, 8)), wr),
+                                                   _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(g, 8)), wg)),
+                                                   _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(b, 8)), wb));
+
+        _mm_storeu_pd(y + 0, y_lo);
+        _mm_storeu_pd(y + 2, y_hi);
+    });
+}
+
+void luma_kernel_sse41(const uint8_t* rgb, float* luma, size_t num_pixels)
+{
+    const __m128 wr = _mm_set1_ps(0.2126f / 255.0f);
+    const __m128 wg = _mm_set1_ps(0.7152f / 255.0f);
+    const __m128 wb = _mm_set1_ps(0.0722f / 255.0f);
+
+    run_luma_blocks<4>(rgb, luma, num_pixels, [&](const uint8_t* p, float* y)
+    {
+        __m128i r, g, b;
+        load_rgb4(p, r, g, b);
+
+        _mm_storeu_ps(y, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(r), wr),
+                                               _mm_mul_ps(_mm_cvtepi32_ps(g), wg)),
+                                               _mm_mul_ps(_mm_cvtepi32_ps(b), wb)));
+    });
+}
+
+void luma_kernel_sse41(const uint8_t* rgb, uint32_t* luma, size_t num_pixels)
+{
+    const __m128i wr = _mm_set1_epi32(2126);
+    const __m128i wg = _mm_set1_epi32(7152);
+    const __m128i wb = _mm_set1_epi32(722);
+
+    run_luma_blocks<4>(rgb, luma, num_pixels, [&](const uint8_t* p, uint32_t* y)
+    {
+        __m128i r, g, b;
+        load_rgb4(p, r, g, b);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y), _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(r, wr), _mm_mullo_epi32(g, wg)), _mm_mullo_epi32(b, wb)));
+    });
+}
+
+#endif
@@ -0,0 +1,232 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "ThreadPool.hpp"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filename)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+    {
+        /* The mapping object may be closed right away, the view keeps it alive */
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (mapping)
+        {
+            void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+
+            if (view)
+            {
+                m_data   = static_cast<const uint8_t*>(view);
+                m_size   = size_t(file_size.QuadPart);
+                m_mapped = true;
+                m_open   = true;
+            }
+        }
+    }
+
+    CloseHandle(file);
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        return;
+    }
+
+    struct stat file_stat;
+
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0)
+    {
+        void* view = mmap(nullptr, size_t(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (view != MAP_FAILED)
+        {
+            /* Decoders read front to back, let the kernel read ahead aggressively */
+            madvise(view, size_t(file_stat.st_size), MADV_SEQUENTIAL);
+
+            m_data   = static_cast<const uint8_t*>(view);
+            m_size   = size_t(file_stat.st_size);
+            m_mapped = true;
+            m_open   = true;
+        }
+    }
+
+    /* The mapping stays valid after the descriptor is closed */
+    close(fd);
+#endif
+
+    /* Empty files, pipes and file systems that don't support mapping */
+    if (!m_open)
+    {
+        m_open = read_into_buffer(filename);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+
+        m_data   = std::exchange(other.m_data, nullptr);
+        m_size   = std::exchange(other.m_size, 0);
+        m_open   = std::exchange(other.m_open, false);
+        m_mapped = std::exchange(other.m_mapped, false);
+        m_buffer = std::move(other.m_buffer);
+    }
+
+    return *this;
+}
+
+bool MappedFile::same_contents(const MappedFile& a, const MappedFile& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+
+    constexpr size_t block_size = size_t(1) << 20;
+
+    const size_t num_blocks = (a.size() + block_size - 1) / block_size;
+
+    /* memcmp is vectorized by the C library, blocks after the first difference are skipped */
+    std::atomic<bool> differs(false);
+
+    ThreadPool::global().parallel_for(num_blocks, [&](size_t block)
+    {
+        if (differs.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        const size_t begin = block * block_size;
+        const size_t count = std::min(block_size, a.size() - begin);
+
+        if (std::memcmp(a.data() + begin, b.data() + begin, count) != 0)
+        {
+            differs.store(true, std::memory_order_relaxed);
+        }
+    });
+
+    return !differs.load();
+}
+
+void MappedFile::release()
+{
+    if (m_mapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+#else
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+    }
+
+    m_data   = nullptr;
+    m_size   = 0;
+    m_open   = false;
+    m_mapped = false;
+    m_buffer.clear();
+}
+
+MappedFile MappedFile::read_stream(FILE* stream, size_t size)
+{
+    MappedFile file;
+    file.m_open = file.read_into_buffer(stream, size) && (size == SIZE_MAX || file.m_size == size);
+
+    return file;
+}
+
+bool MappedFile::read_into_buffer(const std::string& filename)
+{
+    FILE* file = std::fopen(filename.c_str(), "rb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    const bool ok = read_into_buffer(file, SIZE_MAX);
+    std::fclose(file);
+
+    return ok;
+}
+
+bool MappedFile::read_into_buffer(FILE* stream, size_t limit)
+{
+    uint8_t chunk[1 << 16];
+    size_t count;
+
+    while (m_buffer.size() < limit && (count = std::fread(chunk, 1, std::min(sizeof(chunk), limit - m_buffer.size()), stream)) > 0)
+    {
+        m_buffer.insert(m_buffer.end(), chunk, chunk + count);
+    }
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+
+    return !std::ferror(stream);
+}
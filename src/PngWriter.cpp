@@ -0,0 +1,576 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "PngWriter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <stb_image_write.h>
+
+#include "ThreadPool.hpp"
+
+namespace
+{
+    /* Rows are grouped so that every chunk holds roughly this many bytes of filtered data */
+    constexpr size_t chunk_bytes = size_t(1) << 18;
+
+    constexpr uint32_t adler_base = 65521;
+
+    /* Deflate length codes 257..285 and distance codes 0..29 */
+    constexpr uint16_t length_base[29]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    constexpr uint8_t  length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+    constexpr size_t min_match = 3;
+    constexpr size_t max_match = 258;
+    constexpr size_t max_distance = 32768;
+
+    struct Tables
+    {
+        uint32_t crc[256];
+
+        /* Fixed Huffman literal/length codes, already bit-reversed for the LSB-first bit stream */
+        uint16_t lit_code[288];
+        uint8_t  lit_bits[288];
+        uint8_t  dist_code[30];
+
+        /* Length 3..258 -> length code index */
+        uint8_t length_index[max_match + 1];
+
+        Tables()
+        {
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+
+                crc[n] = c;
+            }
+
+            for (int sym = 0; sym < 288; ++sym)
+            {
+                uint32_t code, bits;
+
+                if (sym < 144)      { code = 0x30  + sym;         bits = 8; }
+                else if (sym < 256) { code = 0x190 + (sym - 144); bits = 9; }
+                else if (sym < 280) { code = sym - 256;           bits = 7; }
+                else                { code = 0xC0  + (sym - 280); bits = 8; }
+
+                lit_code[sym] = uint16_t(reverse(code, bits));
+                lit_bits[sym] = uint8_t(bits);
+            }
+
+            for (uint32_t d = 0; d < 30; ++d)
+            {
+                dist_code[d] = uint8_t(reverse(d, 5));
+            }
+
+            for (size_t len = min_match, index = 0; len <= max_match; ++len)
+            {
+                while (index + 1 < 29 && length_base[index + 1] <= len)
+                {
+                    ++index;
+                }
+
+                length_index[len] = uint8_t(index);
+            }
+        }
+
+        static uint32_t reverse(uint32_t code, uint32_t bits)
+        {
+            uint32_t result = 0;
+
+            for (uint32_t i = 0; i < bits; ++i)
+            {
+                result = (result << 1) | ((code >> i) & 1);
+            }
+
+            return result;
+        }
+    };
+
+    const Tables& tables()
+    {
+        static const Tables t;
+        return t;
+    }
+
+    uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t size)
+    {
+        const auto& t = tables();
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            crc = t.crc[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+
+        return crc;
+    }
+
+    uint32_t adler32(const uint8_t* data, size_t size)
+    {
+        uint32_t a = 1, b = 0;
+
+        while (size > 0)
+        {
+            /* 5552 is the largest block for which b can't overflow before the modulo */
+            const size_t block = std::min<size_t>(size, 5552);
+
+            for (size_t i = 0; i < block; ++i)
+            {
+                a += data[i];
+                b += a;
+            }
+
+            a %= adler_base;
+            b %= adler_base;
+
+            data += block;
+            size -= block;
+        }
+
+        return (b << 16) | a;
+    }
+
+    /* Checksum of the concatenation of two blocks, the second one being len2 bytes long (as zlib's adler32_combine) */
+    uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2)
+    {
+        const uint32_t rem = uint32_t(len2 % adler_base);
+
+        uint32_t sum1 = adler1 & 0xFFFF;
+        uint32_t sum2 = uint32_t((uint64_t(rem) * sum1) % adler_base);
+
+        sum1 += (adler2 & 0xFFFF) + adler_base - 1;
+        sum2 += ((adler1 >> 16) & 0xFFFF) + ((adler2 >> 16) & 0xFFFF) + adler_base - rem;
+
+        if (sum1 >= adler_base)       sum1 -= adler_base;
+        if (sum1 >= adler_base)       sum1 -= adler_base;
+        if (sum2 >= adler_base << 1)  sum2 -= adler_base << 1;
+        if (sum2 >= adler_base)       sum2 -= adler_base;
+
+        return (sum2 << 16) | sum1;
+    }
+
+    void put_u32_be(std::vector<uint8_t>& out, uint32_t value)
+    {
+        out.push_back(uint8_t(value >> 24));
+        out.push_back(uint8_t(value >> 16));
+        out.push_back(uint8_t(value >> 8));
+        out.push_back(uint8_t(value));
+    }
+
+    /* LSB-first bit stream as required by deflate */
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<uint8_t>& out) : m_out(out) {}
+
+        void put(uint32_t bits, unsigned count)
+        {
+            m_acc   |= uint64_t(bits) << m_count;
+            m_count += count;
+
+            while (m_count >= 8)
+            {
+                m_out.push_back(uint8_t(m_acc));
+                m_acc   >>= 8;
+                m_count  -= 8;
+            }
+        }
+
+        /* Pads with zero bits up to the next byte boundary */
+        void align()
+        {
+            if (m_count > 0)
+            {
+                put(0, 8 - m_count);
+            }
+        }
+
+    private:
+        std::vector<uint8_t>& m_out;
+        uint64_t m_acc = 0;
+        unsigned m_count = 0;
+    };
+
+    class FixedHuffmanEncoder
+    {
+    public:
+        explicit FixedHuffmanEncoder(std::vector<uint8_t>& out) : m_bits(out), m_tables(tables())
+        {
+            /* BFINAL = 0, BTYPE = 01 (fixed Huffman codes) */
+            m_bits.put(0b010, 3);
+        }
+
+        void literal(uint8_t value)
+        {
+            m_bits.put(m_tables.lit_code[value], m_tables.lit_bits[value]);
+        }
+
+        void match(size_t length, size_t distance)
+        {
+            const unsigned index = m_tables.length_index[length];
+            const unsigned sym   = 257 + index;
+
+            m_bits.put(m_tables.lit_code[sym], m_tables.lit_bits[sym]);
+            m_bits.put(uint32_t(length - length_base[index]), length_extra[index]);
+
+            /* Distance codes 0..3 are exact, after that every power of two is split into two codes */
+            const uint32_t x = uint32_t(distance - 1);
+
+            if (x < 4)
+            {
+                m_bits.put(m_tables.dist_code[x], 5);
+            }
+            else
+            {
+                unsigned n = 1;
+
+                while ((x >> (n + 1)) != 0)
+                {
+                    ++n;
+                }
+
+                const unsigned extra = n - 1;
+
+                m_bits.put(m_tables.dist_code[2 * n + ((x >> extra) & 1)], 5);
+                m_bits.put(x & ((1u << extra) - 1), extra);
+            }
+        }
+
+        /* End of block followed by an empty stored block, which leaves the stream byte aligned */
+        void sync_flush()
+        {
+            m_bits.put(m_tables.lit_code[256], m_tables.lit_bits[256]);
+            m_bits.put(0b000, 3);
+            m_bits.align();
+            m_bits.put(0x0000, 16);
+            m_bits.put(0xFFFF, 16);
+        }
+
+    private:
+        BitWriter m_bits;
+        const Tables& m_tables;
+    };
+
+    /* Stored (uncompressed) non-final blocks, always byte aligned */
+    void deflate_store(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+    {
+        do
+        {
+            const size_t block = std::min<size_t>(size, 65535);
+
+            out.push_back(0x00);
+            out.push_back(uint8_t(block));
+            out.push_back(uint8_t(block >> 8));
+            out.push_back(uint8_t(~block));
+            out.push_back(uint8_t(~block >> 8));
+            out.insert(out.end(), data, data + block);
+
+            data += block;
+            size -= block;
+        } while (size > 0);
+    }
+
+    /* Matches only at distance 1, i.e. runs of the previous byte (zlib's Z_RLE) */
+    void deflate_rle(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+    {
+        FixedHuffmanEncoder encoder(out);
+
+        size_t i = 0;
+
+        while (i < size)
+        {
+            size_t run = 0;
+
+            if (i > 0)
+            {
+                const size_t limit = std::min(max_match, size - i);
+
+                while (run < limit && data[i + run] == data[i - 1])
+                {
+                    ++run;
+                }
+            }
+
+            if (run >= min_match)
+            {
+                encoder.match(run, 1);
+                i += run;
+            }
+            else
+            {
+                encoder.literal(data[i++]);
+            }
+        }
+
+        encoder.sync_flush();
+    }
+
+    /* Greedy LZ77 with a single candidate per 3-byte hash, matches never cross the chunk start */
+    void deflate_fast(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+    {
+        constexpr unsigned hash_bits = 15;
+
+        std::vector<int32_t> head(size_t(1) << hash_bits, -1);
+
+        const auto hash = [data](size_t i)
+        {
+            const uint32_t v = uint32_t(data[i]) | (uint32_t(data[i + 1]) << 8) | (uint32_t(data[i + 2]) << 16);
+            return (v * 2654435761u) >> (32 - hash_bits);
+        };
+
+        FixedHuffmanEncoder encoder(out);
+
+        size_t i = 0;
+
+        while (i + min_match <= size)
+        {
+            const uint32_t h         = hash(i);
+            const int32_t  candidate = head[h];
+
+            head[h] = int32_t(i);
+
+            size_t length = 0;
+
+            if (candidate >= 0 && i - size_t(candidate) <= max_distance)
+            {
+                const size_t limit = std::min(max_match, size - i);
+
+                while (length < limit && data[candidate + length] == data[i + length])
+                {
+                    ++length;
+                }
+            }
+
+            if (length >= min_match)
+            {
+                encoder.match(length, i - size_t(candidate));
+
+                /* Only the last position of the match is indexed, enough to keep long runs going */
+                i += length;
+
+                if (i + min_match <= size)
+                {
+                    head[hash(i - 1)] = int32_t(i - 1);
+                }
+            }
+            else
+            {
+                encoder.literal(data[i++]);
+            }
+        }
+
+        while (i < size)
+        {
+            encoder.literal(data[i++]);
+        }
+
+        encoder.sync_flush();
+    }
+
+    int abs_sum(const uint8_t* filtered, size_t size)
+    {
+        int sum = 0;
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            sum += std::abs(int(int8_t(filtered[i])));
+        }
+
+        return sum;
+    }
+
+    /* Writes the filter type byte followed by the filtered row */
+    void filter_row(const uint8_t* row, const uint8_t* prev_row, size_t row_bytes, PngSpeed speed, uint8_t* out, uint8_t* scratch)
+    {
+        if (speed == PngSpeed::Store)
+        {
+            out[0] = 0;
+            std::memcpy(out + 1, row, row_bytes);
+            return;
+        }
+
+        /* Sub: difference to the pixel on the left */
+        uint8_t* sub = out + 1;
+
+        for (size_t i = 0; i < row_bytes; ++i)
+        {
+            sub[i] = uint8_t(row[i] - (i >= 3 ? row[i - 3] : 0));
+        }
+
+        out[0] = 1;
+
+        if (speed != PngSpeed::Fast || !prev_row)
+        {
+            return;
+        }
+
+        /* Up: difference to the pixel above, kept if it gives smaller residuals */
+        for (size_t i = 0; i < row_bytes; ++i)
+        {
+            scratch[i] = uint8_t(row[i] - prev_row[i]);
+        }
+
+        if (abs_sum(scratch, row_bytes) < abs_sum(sub, row_bytes))
+        {
+            out[0] = 2;
+            std::memcpy(sub, scratch, row_bytes);
+        }
+    }
+
+    /* Complete PNG chunk: length, type, data and CRC of type + data */
+    void put_chunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size)
+    {
+        put_u32_be(out, uint32_t(size));
+
+        const size_t type_offset = out.size();
+
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data, data + size);
+
+        put_u32_be(out, crc32_update(0xFFFFFFFFu, &out[type_offset], size + 4) ^ 0xFFFFFFFFu);
+    }
+
+    void write_callback(void* context, void* data, int size)
+    {
+        std::fwrite(data, 1, size_t(size), static_cast<FILE*>(context));
+    }
+}
+
+PngSpeed png_speed_from_name(const std::string& name)
+{
+    if (name == "store") return PngSpeed::Store;
+    if (name == "rle")   return PngSpeed::Rle;
+    if (name == "best")  return PngSpeed::Best;
+
+    return PngSpeed::Fast;
+}
+
+bool write_png(FILE* file, unsigned width, unsigned height, const uint8_t* rgb, PngSpeed speed)
+{
+    if (speed == PngSpeed::Best)
+    {
+        return stbi_write_png_to_func(write_callback, file, int(width), int(height), 3, rgb, 0) != 0 && !std::ferror(file);
+    }
+
+    const size_t row_bytes      = size_t(width) * 3;
+    const size_t rows_per_chunk = std::max<size_t>(1, chunk_bytes / (row_bytes + 1));
+    const size_t num_chunks     = std::max<size_t>(1, (height + rows_per_chunk - 1) / rows_per_chunk);
+
+    /* Every chunk becomes one IDAT chunk, its CRC and the Adler-32 of its filtered data are computed by the worker */
+    struct Chunk
+    {
+        std::vector<uint8_t> idat;
+        uint32_t adler = 1;
+        size_t   size  = 0;
+    };
+
+    std::vector<Chunk> chunks(num_chunks);
+
+    ThreadPool::global().parallel_for(num_chunks, [&](size_t index)
+    {
+        const size_t first_row = index * rows_per_chunk;
+        const size_t last_row  = std::min<size_t>(height, first_row + rows_per_chunk);
+
+        std::vector<uint8_t> filtered((last_row - first_row) * (row_bytes + 1));
+        std::vector<uint8_t> scratch(row_bytes);
+
+        for (size_t y = first_row; y < last_row; ++y)
+        {
+            const uint8_t* row      = rgb + y * row_bytes;
+            const uint8_t* prev_row = y > 0 ? row - row_bytes : nullptr;
+
+            filter_row(row, prev_row, row_bytes, speed, &filtered[(y - first_row) * (row_bytes + 1)], scratch.data());
+        }
+
+        Chunk& chunk = chunks[index];
+        chunk.adler = adler32(filtered.data(), filtered.size());
+        chunk.size  = filtered.size();
+
+        std::vector<uint8_t> stream;
+        stream.reserve(speed == PngSpeed::Store ? filtered.size() + filtered.size() / 65535 * 5 + 16 : filtered.size() / 2);
+
+        /* The zlib header: deflate with a 32K window, no preset dictionary */
+        if (index == 0)
+        {
+            stream.push_back(0x78);
+            stream.push_back(0x01);
+        }
+
+        switch (speed)
+        {
+            case PngSpeed::Store: deflate_store(filtered.data(), filtered.size(), stream); break;
+            case PngSpeed::Rle:   deflate_rle  (filtered.data(), filtered.size(), stream); break;
+            default:              deflate_fast (filtered.data(), filtered.size(), stream); break;
+        }
+
+        chunk.idat.reserve(stream.size() + 12);
+        put_chunk(chunk.idat, "IDAT", stream.data(), stream.size());
+    });
+
+    uint32_t adler = 1;
+
+    for (const auto& chunk : chunks)
+    {
+        adler = adler32_combine(adler, chunk.adler, chunk.size);
+    }
+
+    std::vector<uint8_t> header = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> ihdr;
+
+    put_u32_be(ihdr, width);
+    put_u32_be(ihdr, height);
+    ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 }); /* 8-bit RGB, deflate, adaptive filtering, no interlace */
+
+    put_chunk(header, "IHDR", ihdr.data(), ihdr.size());
+
+    /* Final empty stored block (BFINAL = 1) and the Adler-32 of the whole stream */
+    std::vector<uint8_t> trailer_data = { 0x01, 0x00, 0x00, 0xFF, 0xFF };
+    put_u32_be(trailer_data, adler);
+
+    std::vector<uint8_t> trailer;
+    put_chunk(trailer, "IDAT", trailer_data.data(), trailer_data.size());
+    put_chunk(trailer, "IEND", nullptr, 0);
+
+    bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+
+    for (const auto& chunk : chunks)
+    {
+        ok = ok && std::fwrite(chunk.idat.data(), 1, chunk.idat.size(), file) == chunk.idat.size();
+    }
+
+    ok = ok && std::fwrite(trailer.data(), 1, trailer.size(), file) == trailer.size();
+
+    return ok && std::fflush(file) == 0;
+}
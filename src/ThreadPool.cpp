@@ -0,0 +1,309 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+struct ThreadPool::Job
+{
+    const std::function<void(size_t)>* task;
+    std::atomic<size_t>                 remaining_tasks{ 0 };
+    std::mutex                          mutex;
+    std::condition_variable             finished;
+};
+
+/* Tasks [begin, end) of a loop */
+struct ThreadPool::Range
+{
+    std::shared_ptr<Job> job;
+    size_t               begin = 0;
+    size_t               end   = 0;
+};
+
+/* The owner pushes and pops at the back, thieves take from the front */
+struct ThreadPool::WorkQueue
+{
+    std::mutex        mutex;
+    std::deque<Range> ranges;
+};
+
+namespace
+{
+    unsigned g_global_threads = 0;
+
+    /* Lets nested parallel_for() calls on a worker use that worker's deque */
+    thread_local const ThreadPool* t_pool = nullptr;
+    thread_local size_t            t_worker_index = 0;
+}
+
+ThreadPool::ThreadPool(unsigned num_threads)
+    : m_queued  (0),
+      m_sleepers(0),
+      m_stop    (false)
+{
+    const size_t num_workers = num_threads > 1 ? num_threads - 1 : 0;
+
+    for (size_t i = 0; i <= num_workers; ++i)
+    {
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    }
+
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_cv.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::size() const
+{
+    return unsigned(m_workers.size()) + 1;
+}
+
+void ThreadPool::parallel_for(size_t num_tasks, const std::function<void(size_t)>& task)
+{
+    if (num_tasks == 0)
+    {
+        return;
+    }
+
+    if (num_tasks == 1 || m_workers.empty())
+    {
+        for (size_t i = 0; i < num_tasks; ++i)
+        {
+            task(i);
+        }
+
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->task = &task;
+    job->remaining_tasks.store(num_tasks);
+
+    const size_t self = t_pool == this ? t_worker_index : m_workers.size();
+
+    push_range(self, { job, 0, num_tasks });
+
+    /* Work on this loop until it is done. Ranges being run elsewhere may still be split, so waiting is short. */
+    while (job->remaining_tasks.load() > 0)
+    {
+        Range range;
+
+        if (take_job_range(*job, self, range))
+        {
+            execute(std::move(range), self);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait_for(lock, std::chrono::microseconds(100), [&] { return job->remaining_tasks.load() == 0; });
+    }
+}
+
+void ThreadPool::set_global_threads(unsigned num_threads)
+{
+    g_global_threads = num_threads;
+}
+
+ThreadPool& ThreadPool::global()
+{
+    static ThreadPool pool(g_global_threads > 0 ? g_global_threads : std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+void ThreadPool::worker_loop(size_t index)
+{
+    t_pool         = this;
+    t_worker_index = index;
+
+    while (true)
+    {
+        Range range;
+
+        if (take_range(index, range))
+        {
+            execute(std::move(range), index);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        /* Paired with the m_sleepers check in push_range(), so a queued range is never missed */
+        ++m_sleepers;
+        m_cv.wait(lock, [this] { return m_stop || m_queued.load() > 0; });
+        --m_sleepers;
+
+        if (m_stop)
+        {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::take_range(size_t self, Range& range)
+{
+    if (m_queued.load() == 0)
+    {
+        return false;
+    }
+
+    const size_t num_queues = m_queues.size();
+
+    for (size_t i = 0; i < num_queues; ++i)
+    {
+        /* Own deque first, then the others (the shared one included) starting with the next one */
+        const size_t index = i == 0 ? self : (self + i) % num_queues;
+        WorkQueue& queue = *m_queues[index];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.ranges.empty())
+        {
+            continue;
+        }
+
+        if (index == self)
+        {
+            range = std::move(queue.ranges.back());
+            queue.ranges.pop_back();
+        }
+        else
+        {
+            range = std::move(queue.ranges.front());
+            queue.ranges.pop_front();
+        }
+
+        --m_queued;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool ThreadPool::take_job_range(const Job& job, size_t self, Range& range)
+{
+    const size_t num_queues = m_queues.size();
+
+    for (size_t i = 0; i < num_queues; ++i)
+    {
+        const size_t index = (self + i) % num_queues;
+        WorkQueue& queue = *m_queues[index];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        auto matches = [&](const Range& queued) { return queued.job.get() == &job; };
+
+        /* The newest range of the own deque keeps the tasks in order, elsewhere the oldest one is the largest */
+        if (index == self)
+        {
+            auto it = std::find_if(queue.ranges.rbegin(), queue.ranges.rend(), matches);
+
+            if (it != queue.ranges.rend())
+            {
+                range = std::move(*it);
+                queue.ranges.erase(std::next(it).base());
+                --m_queued;
+
+                return true;
+            }
+        }
+        else
+        {
+            auto it = std::find_if(queue.ranges.begin(), queue.ranges.end(), matches);
+
+            if (it != queue.ranges.end())
+            {
+                range = std::move(*it);
+                queue.ranges.erase(it);
+                --m_queued;
+
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::push_range(size_t self, Range range)
+{
+    /*
+     * Counted before the range is visible, a thief may take it right away and decrement. The count may
+     * briefly be ahead of the deques, which only sends a woken worker around its loop once more.
+     */
+    ++m_queued;
+
+    {
+        WorkQueue& queue = *m_queues[self];
+
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.ranges.push_back(std::move(range));
+    }
+
+    if (m_sleepers.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cv.notify_one();
+    }
+}
+
+void ThreadPool::execute(Range range, size_t self)
+{
+    Job& job = *range.job;
+
+    /* Split down to single tasks, leaving the upper halves to be stolen */
+    while (range.end - range.begin > 1)
+    {
+        const size_t middle = range.begin + (range.end - range.begin) / 2;
+
+        push_range(self, { range.job, middle, range.end });
+        range.end = middle;
+    }
+
+    (*job.task)(range.begin);
+
+    if (job.remaining_tasks.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.finished.notify_all();
+    }
+}
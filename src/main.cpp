@@ -22,61 +22,132 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
-#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include <cxxopts.hpp>
 
-#include "BaseComparator.hpp"
-#include "LumaComparator.hpp"
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+#include "BatchRunner.hpp"
+#include "DecodedImageCache.hpp"
+#include "ImageComparison.hpp"
+#include "ImageWriters.hpp"
 #include "LabComparator.hpp"
+#include "MappedFile.hpp"
+#include "PngWriter.hpp"
+#include "ThreadPool.hpp"
 
-tinycolormap::ColormapType setColormapType(const std::string& colormap_name)
+PaletteCacheMode setPaletteCacheMode(const std::string& mode_name)
 {
-    static std::unordered_map<std::string, tinycolormap::ColormapType> colormaps = 
+    if (mode_name == "on")
     {
-        {"Parula",  tinycolormap::ColormapType::Parula},
-        {"Heat",    tinycolormap::ColormapType::Heat},
-        {"Hot",     tinycolormap::ColormapType::Hot},
-        {"Jet",     tinycolormap::ColormapType::Jet},
-        {"Gray",    tinycolormap::ColormapType::Gray},
-        {"Magma",   tinycolormap::ColormapType::Magma},
-        {"Inferno", tinycolormap::ColormapType::Inferno},
-        {"Plasma",  tinycolormap::ColormapType::Plasma},
-        {"Viridis", tinycolormap::ColormapType::Viridis},
-        {"Cividis", tinycolormap::ColormapType::Cividis},
-        {"Github",  tinycolormap::ColormapType::Github}
-    };
+        return PaletteCacheMode::On;
+    }
 
-    if (colormaps.count(colormap_name))
+    if (mode_name == "off")
     {
-        return colormaps[colormap_name];
+        return PaletteCacheMode::Off;
     }
 
-    return colormaps["Hot"];
+    return PaletteCacheMode::Auto;
+}
+
+/*
+ * Opens an input image file, "-" reads from stdin instead: the whole stream, or when both inputs
+ * come from stdin, one block prefixed with its length as a little-endian 64-bit integer per image
+ */
+MappedFile openInput(const std::string& filename, bool length_prefixed)
+{
+    if (filename != "-")
+    {
+        return MappedFile(filename);
+    }
+
+    if (!length_prefixed)
+    {
+        return MappedFile::read_stream(stdin);
+    }
+
+    uint8_t prefix[8];
+
+    if (std::fread(prefix, 1, sizeof(prefix), stdin) != sizeof(prefix))
+    {
+        return MappedFile();
+    }
+
+    uint64_t size = 0;
+
+    for (int i = 7; i >= 0; --i)
+    {
+        size = (size << 8) | prefix[i];
+    }
+
+    if (size > uint64_t(SIZE_MAX))
+    {
+        return MappedFile();
+    }
+
+    return MappedFile::read_stream(stdin, size_t(size));
 }
 
 int main(int argc, char* argv[])
 {
     cxxopts::Options options("colorimgdiff", "Creates diff image of ref(erence) and src (source) images.\n");
-    options.add_options()("r,ref",      "Relative path to reference image WITH extension [REQUIRED]",             cxxopts::value<std::string>())
-                         ("s,src",      "Relative path to source image WITH extension    [REQUIRED]",             cxxopts::value<std::string>())
-                         ("o,out",      "Relative path to output image WITHOUT extension (it'll be a PNG image)", cxxopts::value<std::string>()->default_value("output_diff"))
+    options.add_options()("r,ref",      "Relative path to reference image WITH extension, - for stdin [REQUIRED]", cxxopts::value<std::string>())
+                         ("s,src",      "Relative path(s) to source image(s) WITH extension, - for stdin [REQUIRED]", cxxopts::value<std::vector<std::string>>())
+                         ("o,out",      "Relative path to output image. A .png, .ppm, .qoi, .pfm or .raw "
+                                        "extension selects the format, otherwise --format is appended. "
+                                        "- writes to stdout.",                                                    cxxopts::value<std::string>()->default_value("output_diff"))
+                         ("format",     "Output format used when --out has no known extension: png, ppm, qoi "
+                                        "(colormapped), pfm or raw (unnormalized float32 error).",                cxxopts::value<std::string>()->default_value("png"))
                          ("c,colormap", "Changes the default colormap. Possible options are: Parula, Heat, "
                                         "Hot, Jet, Gray, Magma, Inferno, Plasma, Viridis, Cividis, Github.",      cxxopts::value<std::string>()->default_value("Hot"))
-                         //("i,interpolate", "Choose a value from range [1, 255] if you want to disable color "
-                         //                  "interpolation (default) and want to assign several values to the "
-                         //                  "same color.",                                                       cxxopts::value<int>()->default_value("-1"))
+                         ("i,interpolate", "Choose a value from range [1, 255] if you want to disable color "
+                                           "interpolation (default) and want to assign several values to the "
+                                           "same color.",                                                       cxxopts::value<int>()->default_value("-1"))
                          ("m,mode",      "Sets the comparison mode. Available options are: Luma, Lab.",           cxxopts::value<std::string>()->default_value("Luma"))
+                         ("precision",   "Per-pixel arithmetic precision: double or float (faster, the "
+                                         "metric changes in the last digits and a few diff image pixels may "
+                                         "land one colormap step off). Metrics are accumulated in double "
+                                         "either way. Luma mode also accepts fixed (integer arithmetic with "
+                                         "exact sums, 8-bit inputs only, 16-bit ones use double).",               cxxopts::value<std::string>()->default_value("double"))
+                         ("palette-cache", "Memoize L*a*b* conversions of repeated colors: auto (detects images with "
+                                           "few distinct colors), on or off.",                                  cxxopts::value<std::string>()->default_value("auto"))
+                         ("png-speed",   "PNG encoder setting: store, rle, fast (multithreaded) or best "
+                                         "(smallest files, slowest).",                                            cxxopts::value<std::string>()->default_value("fast"))
+                         ("cache-dir",   "Directory for caching decoded reference images between runs (disabled "
+                                         "when empty).",                                                          cxxopts::value<std::string>()->default_value(""))
+                         ("cache-size",  "Size limit of --cache-dir in MiB, least recently used entries are "
+                                         "removed first.",                                                        cxxopts::value<unsigned>()->default_value("4096"))
+                         ("skip-identical-output", "Don't write the diff image when ref and src are byte-identical "
+                                                   "files (they're never decoded or compared).",                 cxxopts::value<bool>()->default_value("false"))
+                         ("batch",       "Compares every pair of a JSON Lines manifest (- for stdin) in one process. Each "
+                                         "line holds \"ref\", \"src\", \"out\" and optionally \"mode\" and "
+                                         "\"colormap\". Results are written to stdout as JSON Lines.",                 cxxopts::value<std::string>())
+                         ("dir",         "Treats <ref_image> and <src_image> as directory trees: images are matched by "
+                                         "relative path, diffs are written below --out and images missing on "
+                                         "either side are reported. Results are written to stdout as JSON Lines.", cxxopts::value<bool>()->default_value("false"))
+                         ("j,jobs",      "Number of pairs decoded at the same time in --batch, --dir and multi-source "
+                                         "modes, 0 uses one per hardware thread.",                                 cxxopts::value<unsigned>()->default_value("0"))
+                         ("compare-jobs", "Number of pairs compared at the same time in --batch, --dir and "
+                                          "multi-source modes, 0 uses one per hardware thread.",                   cxxopts::value<unsigned>()->default_value("0"))
+                         ("encode-jobs", "Number of diff images encoded and written at the same time in --batch, "
+                                         "--dir and multi-source modes, 0 uses one per hardware thread.",          cxxopts::value<unsigned>()->default_value("0"))
+                         ("t,threads",   "Number of threads used for the comparison, 0 uses all hardware threads.", cxxopts::value<unsigned>()->default_value("0"))
                          ("v,verbose",   "Verbose output",                                                        cxxopts::value<bool>()->default_value("false"))
                          ("p,printmetricfile", "Print metric(s) value to a *.txt file.",                                cxxopts::value<bool>()->default_value("false"))
                          ("h,help",      "Prints this message");
     
-    options.positional_help("<ref_image> <src_image>");
+    options.positional_help("<ref_image> <src_image>...");
     options.parse_positional({ "ref", "src" });
 
     auto cmd_result = options.parse(argc, argv);
@@ -87,104 +158,109 @@ int main(int argc, char* argv[])
         exit(0);
     }
 
-    if (!cmd_result.count("ref") || !cmd_result.count("src"))
+    const bool batch    = cmd_result.count("batch") > 0;
+    const bool dir_mode = cmd_result["dir"].as<bool>();
+
+    if (!batch && (!cmd_result.count("ref") || !cmd_result.count("src")))
     {
         std::cerr << "ERROR: You have to specify relative paths to reference and source images repectively!\n\n";
         std::cout << options.help() << std::endl;
         exit(0);
     }
 
-    int interpolation_ranges  = -1;// cmd_result["interpolate"].as<int>();
-    bool verbose_output       = cmd_result["verbose"].as<bool>();
-    bool print_metric_to_file = cmd_result["printmetricfile"].as<bool>();
-    auto comp_mode            = cmd_result["mode"].as<std::string>();
-    auto colormap_type        = setColormapType(cmd_result["colormap"].as<std::string>());
+    ComparisonSettings settings;
+    settings.mode                  = cmd_result["mode"].as<std::string>();
+    settings.precision             = cmd_result["precision"].as<std::string>();
+    settings.colormap_type         = colormap_type_from_name(cmd_result["colormap"].as<std::string>());
+    settings.interpolation_ranges  = cmd_result["interpolate"].as<int>();
+    settings.palette_cache_mode    = setPaletteCacheMode(cmd_result["palette-cache"].as<std::string>());
+    settings.png_speed             = png_speed_from_name(cmd_result["png-speed"].as<std::string>());
+    settings.skip_identical_output = cmd_result["skip-identical-output"].as<bool>();
+    settings.print_metric_to_file  = cmd_result["printmetricfile"].as<bool>();
+
+    bool verbose_output = cmd_result["verbose"].as<bool>();
+
+    ThreadPool::set_global_threads(cmd_result["threads"].as<unsigned>());
 
-    std::string ref_filename = cmd_result["ref"].as<std::string>();
-    std::string src_filename = cmd_result["src"].as<std::string>();
     std::string out_filename = cmd_result["out"].as<std::string>();
 
-    ImageMetadata ref_metadata, src_metadata;
+    /* The extension is stripped so that metric files are named after the output stem */
+    const bool out_has_extension = !batch && !dir_mode && split_output_extension(out_filename, settings.output_format);
 
-    auto ref_data = BaseComparator::load_image(ref_filename, ref_metadata);
-    auto src_data = BaseComparator::load_image(src_filename, src_metadata);
+    /* In --batch mode --format is the default for records whose "out" has no extension, --dir mode always uses it */
+    if (!out_has_extension && !output_format_from_name(cmd_result["format"].as<std::string>(), settings.output_format))
+    {
+        std::cerr << "ERROR: Unknown output format " << cmd_result["format"].as<std::string>() << std::endl;
+        return 1;
+    }
 
-    if (verbose_output)
+    if (!is_precision_name(settings.precision))
     {
-        if (ref_data.empty())
-        {
-            std::cerr << "Couldn't load " << ref_filename << std::endl;
-            return 1;
-        }
+        std::cerr << "ERROR: Unknown precision " << settings.precision << std::endl;
+        return 1;
+    }
 
-        if (src_data.empty())
-        {
-            std::cerr << "Couldn't load " << src_filename << std::endl;
-            return 1;
-        }
+#ifdef _WIN32
+    _setmode(_fileno(stdin),  _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
 
-        if (ref_data.size() != src_data.size())
-        {
-            std::cerr << "Ref ans Src images' dimensions don't match!" << std::endl;
-            return 1;
-        }
+    std::unique_ptr<DecodedImageCache> ref_cache;
+
+    if (!cmd_result["cache-dir"].as<std::string>().empty())
+    {
+        ref_cache = std::make_unique<DecodedImageCache>(cmd_result["cache-dir"].as<std::string>(), uint64_t(cmd_result["cache-size"].as<unsigned>()) << 20);
+        settings.ref_cache = ref_cache.get();
     }
 
-    std::shared_ptr<BaseComparator> comparator;
+    PipelineJobs jobs;
+    jobs.decode  = cmd_result["jobs"].as<unsigned>();
+    jobs.compare = cmd_result["compare-jobs"].as<unsigned>();
+    jobs.encode  = cmd_result["encode-jobs"].as<unsigned>();
 
-    if (comp_mode == "Luma")
+    if (batch)
     {
-        if (verbose_output)
-        {
-            std::cout << "Comparing luminance..." << std::endl;
-        }
+        return run_batch(cmd_result["batch"].as<std::string>(), settings, jobs, std::cout, std::cerr) ? 0 : 1;
+    }
 
-        comparator = std::make_shared<LumaComparator>(colormap_type, out_filename, ref_metadata.width, ref_metadata.height, interpolation_ranges);
-        comparator->compare(ref_data, src_data);
+    std::string ref_filename = cmd_result["ref"].as<std::string>();
+    const auto& src_filenames = cmd_result["src"].as<std::vector<std::string>>();
 
-        if (verbose_output)
+    /* Several sources are compared with one reference that is only decoded once */
+    if (src_filenames.size() > 1)
+    {
+        if (dir_mode || out_filename == "-" || std::find(src_filenames.begin(), src_filenames.end(), "-") != src_filenames.end())
         {
-            std::cout << "Saved image " << out_filename << std::endl;
-            std::cout << "MSE:  " << comparator->get_error() << std::endl;
-            std::cout << "RMSE: " << std::sqrt(comparator->get_error()) << std::endl;
+            std::cerr << "ERROR: Several sources can't be combined with --dir, a - source or -o -" << std::endl;
+            return 1;
         }
 
-        if (print_metric_to_file)
-        {
-            auto mse_filename  = out_filename + "_mse.txt";
-            auto rmse_filename = out_filename + "_rmse.txt";
+        return run_reference_diff(ref_filename, openInput(ref_filename, false), src_filenames, out_filename, settings, jobs, std::cout, std::cerr) ? 0 : 1;
+    }
 
-            std::ofstream out_file(mse_filename);
-            out_file << comparator->get_error();
-            out_file.close();
+    std::string src_filename = src_filenames.front();
 
-            out_file.open(rmse_filename);
-            out_file << std::sqrt(comparator->get_error());
-        }
+    if (dir_mode)
+    {
+        return run_directory_diff(ref_filename, src_filename, out_filename, settings, jobs, std::cout, std::cerr) ? 0 : 1;
     }
 
-    if (comp_mode == "Lab")
-    {
-        if (verbose_output)
-        {
-            std::cout << "Comparing color in L*a*b* space..." << std::endl;
-        }
-        
-        comparator = std::make_shared<LabComparator>(colormap_type, out_filename, ref_metadata.width, ref_metadata.height, interpolation_ranges);
-        comparator->compare(ref_data, src_data);
+    /* With the diff image on stdout, messages go to stderr */
+    std::ostream& log = out_filename == "-" ? std::cerr : std::cout;
 
-        if (verbose_output)
-        {
-            std::cout << "Saved image " << out_filename << std::endl;
-            std::cout << "delta E*ab:  " << comparator->get_error() << std::endl;
-        }
+    /* Mapped files or, for "-", stdin contents */
+    const bool both_stdin = ref_filename == "-" && src_filename == "-";
 
-        if (print_metric_to_file)
-        {
-            std::ofstream out_file(out_filename + "_delta_e.txt");
-            out_file << comparator->get_error();
-        }
+    const MappedFile ref_file = openInput(ref_filename, both_stdin);
+    const MappedFile src_file = openInput(src_filename, both_stdin);
+
+    const ComparisonResult result = compare_images(ref_filename, ref_file, src_filename, src_file, out_filename, settings, verbose_output ? &log : nullptr);
+
+    if (!result.ok)
+    {
+        std::cerr << result.error_message << std::endl;
+        return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
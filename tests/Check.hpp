@@ -0,0 +1,62 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+/*
+ * Minimal assertions for the test executables: a failed check is reported with its location
+ * and counted, main() returns check_failures() != 0 at the end.
+ */
+inline int& check_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                        \
+    do                                                                                          \
+    {                                                                                           \
+        if (!(condition))                                                                       \
+        {                                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n";     \
+            ++check_failures();                                                                 \
+        }                                                                                       \
+    } while (false)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                                 \
+    do                                                                                          \
+    {                                                                                           \
+        const double check_actual_   = double(actual);                                          \
+        const double check_expected_ = double(expected);                                        \
+        if (!(std::fabs(check_actual_ - check_expected_) <= double(tolerance)))                 \
+        {                                                                                       \
+            std::cerr.precision(17);                                                            \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_NEAR(" #actual ", " #expected  \
+                      << ") failed: " << check_actual_ << " vs " << check_expected_ << "\n";    \
+            ++check_failures();                                                                 \
+        }                                                                                       \
+    } while (false)
@@ -0,0 +1,144 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ColormapLut against tinycolormap::GetColor, within the tolerance documented in ColormapLut.hpp */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <utility>
+
+#include "Check.hpp"
+#include "ColormapLut.hpp"
+
+namespace
+{
+    using tinycolormap::ColormapType;
+
+    /* Largest channel difference from GetColor over random values */
+    int max_difference(const ColormapLut& lut, ColormapType type, bool as_float)
+    {
+        std::mt19937_64 rng(7);
+        std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+        int max_diff = 0;
+
+        for (int i = 0; i < 200000; ++i)
+        {
+            const double x = as_float ? double(float(distribution(rng))) : distribution(rng);
+
+            uint8_t rgb[3];
+
+            if (as_float)
+            {
+                lut.lookup(float(x), rgb);
+            }
+            else
+            {
+                lut.lookup(x, rgb);
+            }
+
+            const tinycolormap::Color color = tinycolormap::GetColor(x, type);
+
+            max_diff = std::max({ max_diff, std::abs(rgb[0] - color.ri()), std::abs(rgb[1] - color.gi()), std::abs(rgb[2] - color.bi()) });
+        }
+
+        return max_diff;
+    }
+
+    void test_tolerance()
+    {
+        /* Table-based colormaps step on entry boundaries, interpolated ones may be one level off */
+        const std::pair<ColormapType, int> colormaps[] = {
+            { ColormapType::Parula,  0 }, { ColormapType::Magma,   0 }, { ColormapType::Inferno, 0 },
+            { ColormapType::Plasma,  0 }, { ColormapType::Viridis, 0 }, { ColormapType::Cividis, 0 },
+            { ColormapType::Heat,    1 }, { ColormapType::Jet,     1 }, { ColormapType::Hot,     1 },
+            { ColormapType::Gray,    1 }, { ColormapType::Github,  1 }
+        };
+
+        for (const auto& colormap : colormaps)
+        {
+            const ColormapLut lut(colormap.first, -1);
+
+            for (const bool as_float : { false, true })
+            {
+                const int diff = max_difference(lut, colormap.first, as_float);
+
+                if (diff > colormap.second)
+                {
+                    std::cerr << "Colormap " << int(colormap.first) << (as_float ? " (float)" : " (double)") << " is " << diff << " levels off\n";
+                    ++check_failures();
+                }
+            }
+        }
+    }
+
+    void test_ends_and_clamping()
+    {
+        const ColormapLut lut(ColormapType::Viridis, -1);
+
+        for (const double x : { -1.0, 0.0, 1.0, 2.0 })
+        {
+            uint8_t rgb[3];
+            lut.lookup(x, rgb);
+
+            const tinycolormap::Color color = tinycolormap::GetColor(x < 0.5 ? 0.0 : 1.0, ColormapType::Viridis);
+
+            CHECK(rgb[0] == color.ri() && rgb[1] == color.gi() && rgb[2] == color.bi());
+        }
+    }
+
+    /* --interpolate N: N flat bands, band k has the color at k / (N - 1) */
+    void test_bands()
+    {
+        const ColormapLut lut(ColormapType::Jet, 4);
+
+        for (int band = 0; band < 4; ++band)
+        {
+            const tinycolormap::Color color = tinycolormap::GetColor(band / 3.0, ColormapType::Jet);
+
+            for (const double offset : { 0.05, 0.125, 0.2 })
+            {
+                uint8_t rgb[3];
+                lut.lookup(band / 4.0 + offset, rgb);
+
+                CHECK(rgb[0] == color.ri() && rgb[1] == color.gi() && rgb[2] == color.bi());
+            }
+        }
+
+        /* Every table is baked once per process */
+        CHECK(ColormapLut::get(ColormapType::Jet, 4) == ColormapLut::get(ColormapType::Jet, 4));
+        CHECK(ColormapLut::get(ColormapType::Jet, 0) == ColormapLut::get(ColormapType::Jet, -1));
+    }
+}
+
+int main()
+{
+    test_tolerance();
+    test_ends_and_clamping();
+    test_bands();
+
+    return check_failures() != 0;
+}
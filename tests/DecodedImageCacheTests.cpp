@@ -0,0 +1,190 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* DecodedImageCache: hits, entry format, eviction and cleanup of stale temporary files */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "BaseComparator.hpp"
+#include "Check.hpp"
+#include "DecodedImageCache.hpp"
+#include "Image.hpp"
+#include "MappedFile.hpp"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    std::string g_data_dir;
+
+    /* cache_test in the output directory */
+    fs::path g_cache_dir;
+
+    /* Entries in the cache directory, temporary files included */
+    std::vector<fs::path> cache_files()
+    {
+        std::vector<fs::path> files;
+
+        for (const auto& entry : fs::directory_iterator(g_cache_dir))
+        {
+            files.push_back(entry.path());
+        }
+
+        return files;
+    }
+
+    bool same_pixels(const Image& a, const Image& b)
+    {
+        return !a.empty() && a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+    }
+
+    void create_file(const fs::path& path, size_t size, std::chrono::hours age)
+    {
+        FILE* file = std::fopen(path.string().c_str(), "wb");
+        CHECK(file != nullptr);
+
+        if (file)
+        {
+            const std::vector<char> zeros(size);
+            std::fwrite(zeros.data(), 1, zeros.size(), file);
+            std::fclose(file);
+        }
+
+        fs::last_write_time(path, fs::file_time_type::clock::now() - age);
+    }
+
+    void test_hits(int bit_depth)
+    {
+        fs::remove_all(g_cache_dir);
+
+        const MappedFile file(g_data_dir + "/1a.png");
+        const ImageView encoded(file.data(), file.size());
+
+        ImageMetadata decoded_metadata;
+        decoded_metadata.bit_depth = bit_depth;
+        const Image decoded = BaseComparator::decode_image(encoded, decoded_metadata);
+
+        DecodedImageCache cache(g_cache_dir.string(), uint64_t(1) << 30);
+
+        /* A miss decodes and writes the entry, a hit maps it */
+        for (int i = 0; i < 2; ++i)
+        {
+            ImageMetadata metadata;
+            metadata.bit_depth = bit_depth;
+
+            const Image img = cache.load(encoded, metadata);
+
+            CHECK(same_pixels(img, decoded));
+            CHECK(img.bit_depth() == bit_depth);
+            CHECK(metadata.width == decoded_metadata.width && metadata.height == decoded_metadata.height && metadata.nr_channels == 3);
+        }
+
+        const std::vector<fs::path> files = cache_files();
+
+        CHECK(files.size() == 1);
+
+        if (files.size() == 1)
+        {
+            CHECK(files[0].extension() == ".rgb");
+            CHECK(fs::file_size(files[0]) == 32 + decoded.size());
+
+            const MappedFile entry(files[0].string());
+            CHECK(entry.is_open() && std::memcmp(entry.data(), "CIDIMG1", 8) == 0);
+        }
+    }
+
+    void test_temporary_files()
+    {
+        fs::remove_all(g_cache_dir);
+        fs::create_directories(g_cache_dir);
+
+        const fs::path stale = g_cache_dir / "0000000000000000-1-8.rgb.tmp1-0";
+        const fs::path live  = g_cache_dir / "0000000000000000-1-8.rgb.tmp2-0";
+
+        create_file(stale, 100, std::chrono::hours(2));
+        create_file(live, 100, std::chrono::hours(0));
+
+        /* Opening the cache scans the directory */
+        DecodedImageCache cache(g_cache_dir.string(), uint64_t(1) << 30);
+
+        CHECK(!fs::exists(stale));
+        CHECK(fs::exists(live));
+    }
+
+    void test_eviction()
+    {
+        fs::remove_all(g_cache_dir);
+        fs::create_directories(g_cache_dir);
+
+        const MappedFile file_a(g_data_dir + "/1a.png");
+        const MappedFile file_b(g_data_dir + "/1b.png");
+
+        const uint64_t entry_size = 32 + 600 * 600 * 3;
+
+        /* An old entry left by another process, it's the least recently used one */
+        const fs::path old_entry = g_cache_dir / "0000000000000000-1-8.rgb";
+        create_file(old_entry, entry_size, std::chrono::hours(1));
+
+        /* Room for two entries */
+        DecodedImageCache cache(g_cache_dir.string(), 2 * entry_size + entry_size / 2);
+
+        ImageMetadata metadata;
+        CHECK(!cache.load(ImageView(file_a.data(), file_a.size()), metadata).empty());
+        CHECK(cache_files().size() == 2);
+
+        /* The third entry goes over the limit, eviction goes down to 3/4 of it */
+        CHECK(!cache.load(ImageView(file_b.data(), file_b.size()), metadata).empty());
+
+        CHECK(!fs::exists(old_entry));
+        CHECK(cache_files().size() == 1);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: DecodedImageCacheTests <directory of the test images> <output directory>\n";
+        return 2;
+    }
+
+    g_data_dir  = argv[1];
+    g_cache_dir = fs::path(argv[2]) / "cache_test";
+
+    test_hits(8);
+    test_hits(16);
+    test_temporary_files();
+    test_eviction();
+
+    std::error_code error;
+    fs::remove_all(g_cache_dir, error);
+
+    return check_failures() != 0;
+}
@@ -0,0 +1,131 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * FixedPointLumaComparator on extreme inputs: black against white (each image is normalized to its own
+ * range first) squares the full-scale difference, which has to be done in unsigned arithmetic (see
+ * squared_difference()). Both the direct and the prepared-reference path are checked against the double
+ * LumaComparator; build with -fsanitize=undefined to catch an overflow.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Check.hpp"
+#include "FixedPointLumaComparator.hpp"
+#include "Image.hpp"
+#include "LumaComparator.hpp"
+
+namespace
+{
+    constexpr unsigned width  = 256;
+    constexpr unsigned height = 4;
+
+    /* Gray ramp from black to white along each row, or from white to black when inverted */
+    std::vector<uint8_t> gradient(bool inverted)
+    {
+        std::vector<uint8_t> rgb(size_t(width) * height * 3);
+
+        for (size_t i = 0; i < size_t(width) * height; ++i)
+        {
+            const uint8_t value = uint8_t(inverted ? 255 - i % width : i % width);
+
+            rgb[3 * i + 0] = value;
+            rgb[3 * i + 1] = value;
+            rgb[3 * i + 2] = value;
+        }
+
+        return rgb;
+    }
+
+    double fixed_mse(const std::vector<uint8_t>& ref, const std::vector<uint8_t>& src, bool prepared)
+    {
+        FixedPointLumaComparator comparator(tinycolormap::ColormapType::Hot, "unused", width, height, -1);
+
+        if (prepared)
+        {
+            comparator.compare(*comparator.prepare_reference(ref), src);
+        }
+        else
+        {
+            comparator.compare(ref, src);
+        }
+
+        return comparator.get_error();
+    }
+
+    double double_mse(const std::vector<uint8_t>& ref, const std::vector<uint8_t>& src)
+    {
+        LumaComparator<double> comparator(tinycolormap::ColormapType::Hot, "unused", width, height, -1);
+        comparator.compare(ref, src);
+
+        return comparator.get_error();
+    }
+
+    /* Alternating black and white pixels against the opposite pattern */
+    void test_black_against_white()
+    {
+        std::vector<uint8_t> pattern(size_t(width) * height * 3);
+        std::vector<uint8_t> inverted(pattern.size());
+
+        for (size_t i = 0; i < pattern.size(); ++i)
+        {
+            pattern[i]  = (i / 3) % 2 ? 255 : 0;
+            inverted[i] = uint8_t(255 - pattern[i]);
+        }
+
+        /* Every squared difference is exactly unit^2 */
+        CHECK(fixed_mse(pattern, inverted, false) == 1.0);
+        CHECK(fixed_mse(pattern, inverted, true) == 1.0);
+        CHECK(fixed_mse(inverted, pattern, false) == 1.0);
+        CHECK(fixed_mse(inverted, pattern, true) == 1.0);
+    }
+
+    void test_inverted_gradient()
+    {
+        const std::vector<uint8_t> ramp     = gradient(false);
+        const std::vector<uint8_t> inverted = gradient(true);
+
+        const double expected = double_mse(ramp, inverted);
+
+        /* The sum is exact, so both paths agree bit for bit */
+        const double direct = fixed_mse(ramp, inverted, false);
+
+        CHECK(direct == fixed_mse(ramp, inverted, true));
+        constexpr double unit = FixedPointLumaComparator::unit;
+        CHECK_NEAR(direct, expected, (2.0 * std::sqrt(expected) + 1.0 / unit) / unit);
+
+        CHECK(fixed_mse(inverted, ramp, false) == direct);
+        CHECK(fixed_mse(ramp, ramp, false) == 0.0);
+    }
+}
+
+int main()
+{
+    test_black_against_white();
+    test_inverted_gradient();
+
+    return check_failures() != 0;
+}
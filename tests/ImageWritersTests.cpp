@@ -0,0 +1,301 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* The PPM, QOI, PFM and raw float writers, QOI output is read back with a decoder following the specification */
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "ImageWriters.hpp"
+
+namespace
+{
+    /* Everything written to file, which is closed afterwards */
+    std::vector<uint8_t> read_back(FILE* file)
+    {
+        std::vector<uint8_t> bytes;
+
+        std::rewind(file);
+
+        for (int c; (c = std::fgetc(file)) != EOF;)
+        {
+            bytes.push_back(uint8_t(c));
+        }
+
+        std::fclose(file);
+
+        return bytes;
+    }
+
+    uint32_t get_u32_be(const uint8_t* p)
+    {
+        return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+    }
+
+    /* Decodes QOI to RGBA (https://qoiformat.org/qoi-specification.pdf), returns false on malformed data */
+    bool decode_qoi(const std::vector<uint8_t>& data, unsigned& width, unsigned& height, std::vector<uint8_t>& rgba)
+    {
+        static const uint8_t end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+        if (data.size() < 14 + 8 || std::memcmp(data.data(), "qoif", 4) != 0 ||
+            std::memcmp(data.data() + data.size() - 8, end_marker, 8) != 0)
+        {
+            return false;
+        }
+
+        width  = get_u32_be(&data[4]);
+        height = get_u32_be(&data[8]);
+
+        const size_t num_pixels = size_t(width) * height;
+        const size_t end = data.size() - 8;
+
+        std::array<std::array<uint8_t, 4>, 64> index = {};
+        std::array<uint8_t, 4> px = { 0, 0, 0, 255 };
+
+        rgba.clear();
+
+        size_t pos = 14;
+
+        while (rgba.size() < 4 * num_pixels)
+        {
+            if (pos >= end)
+            {
+                return false;
+            }
+
+            const uint8_t b = data[pos++];
+            unsigned run = 1;
+
+            if (b == 0xFE && end - pos >= 3)
+            {
+                px = { data[pos], data[pos + 1], data[pos + 2], px[3] };
+                pos += 3;
+            }
+            else if (b == 0xFF && end - pos >= 4)
+            {
+                px = { data[pos], data[pos + 1], data[pos + 2], data[pos + 3] };
+                pos += 4;
+            }
+            else if ((b >> 6) == 0)
+            {
+                px = index[b];
+            }
+            else if ((b >> 6) == 1)
+            {
+                px[0] = uint8_t(px[0] + ((b >> 4) & 3) - 2);
+                px[1] = uint8_t(px[1] + ((b >> 2) & 3) - 2);
+                px[2] = uint8_t(px[2] + (b & 3) - 2);
+            }
+            else if ((b >> 6) == 2 && pos < end)
+            {
+                const int dg = (b & 63) - 32;
+                const uint8_t b2 = data[pos++];
+
+                px[0] = uint8_t(px[0] + dg - 8 + (b2 >> 4));
+                px[1] = uint8_t(px[1] + dg);
+                px[2] = uint8_t(px[2] + dg - 8 + (b2 & 15));
+            }
+            else if ((b >> 6) == 3 && b < 0xFE)
+            {
+                run = (b & 63) + 1u;
+            }
+            else
+            {
+                return false;
+            }
+
+            index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64] = px;
+
+            for (; run > 0; --run)
+            {
+                rgba.insert(rgba.end(), px.begin(), px.end());
+            }
+        }
+
+        return pos == end && rgba.size() == 4 * num_pixels;
+    }
+
+    void check_qoi_round_trip(unsigned width, unsigned height, const std::vector<uint8_t>& rgb)
+    {
+        FILE* file = std::tmpfile();
+        CHECK(file != nullptr);
+
+        if (!file)
+        {
+            return;
+        }
+
+        CHECK(write_qoi(file, width, height, rgb.data()));
+
+        const std::vector<uint8_t> data = read_back(file);
+
+        CHECK(data.size() >= 14 && data[12] == 3 && data[13] == 0);
+
+        unsigned decoded_width = 0;
+        unsigned decoded_height = 0;
+        std::vector<uint8_t> rgba;
+
+        CHECK(decode_qoi(data, decoded_width, decoded_height, rgba));
+        CHECK(decoded_width == width && decoded_height == height);
+
+        bool same = rgba.size() == 4 * rgb.size() / 3;
+
+        for (size_t i = 0; same && i < rgb.size() / 3; ++i)
+        {
+            same = rgba[4 * i] == rgb[3 * i] && rgba[4 * i + 1] == rgb[3 * i + 1] && rgba[4 * i + 2] == rgb[3 * i + 2] && rgba[4 * i + 3] == 255;
+        }
+
+        CHECK(same);
+    }
+
+    void test_qoi()
+    {
+        /*
+         * Black after another color hashes to an index entry the encoder never stored, the decoder's
+         * (0, 0, 0, 0) must not be referenced for it
+         */
+        check_qoi_round_trip(3, 1, { 200, 10, 10, 0, 0, 0, 200, 10, 10 });
+
+        /* Runs longer than 62 pixels, repeated colors, small and large steps */
+        std::vector<uint8_t> rgb;
+        uint32_t state = 12345;
+
+        while (rgb.size() < 3 * 97 * 61)
+        {
+            state = state * 1664525u + 1013904223u;
+
+            const unsigned kind   = state >> 29;
+            const unsigned length = kind == 0 ? 1 + (state >> 8) % 150 : 1;
+            const size_t previous = rgb.size();
+
+            std::array<uint8_t, 3> px = { 0, 0, 0 };
+
+            if (previous >= 3)
+            {
+                px = { rgb[previous - 3], rgb[previous - 2], rgb[previous - 1] };
+            }
+
+            switch (kind)
+            {
+                case 1:  px = { uint8_t(state >> 8), uint8_t(state >> 16), uint8_t(state >> 24) }; break;
+                case 2:  px = { uint8_t(px[0] + 1), uint8_t(px[1] - 2), px[2] }; break;
+                case 3:  px = { uint8_t(px[0] + 20), uint8_t(px[1] + 25), uint8_t(px[2] + 30) }; break;
+                case 4:  px = { uint8_t((state >> 8) % 4 * 60), 0, 0 }; break;
+                default: break;
+            }
+
+            for (unsigned i = 0; i < length && rgb.size() < 3 * 97 * 61; ++i)
+            {
+                rgb.insert(rgb.end(), px.begin(), px.end());
+            }
+        }
+
+        check_qoi_round_trip(97, 61, rgb);
+    }
+
+    void test_ppm()
+    {
+        const std::vector<uint8_t> rgb = { 1, 2, 3, 4, 5, 6 };
+
+        FILE* file = std::tmpfile();
+        CHECK(file != nullptr && write_ppm(file, 2, 1, rgb.data()));
+
+        const std::string header = "P6\n2 1\n255\n";
+        const std::vector<uint8_t> data = file ? read_back(file) : std::vector<uint8_t>();
+
+        CHECK(data.size() == header.size() + rgb.size());
+        CHECK(std::equal(header.begin(), header.end(), data.begin()) && std::equal(rgb.begin(), rgb.end(), data.begin() + header.size()));
+    }
+
+    /* Little-endian floats from the byte offset on */
+    std::vector<float> get_floats_le(const std::vector<uint8_t>& data, size_t offset)
+    {
+        std::vector<float> values;
+
+        for (size_t pos = offset; pos + 4 <= data.size(); pos += 4)
+        {
+            const uint32_t bits = uint32_t(data[pos]) | uint32_t(data[pos + 1]) << 8 | uint32_t(data[pos + 2]) << 16 | uint32_t(data[pos + 3]) << 24;
+
+            float value;
+            std::memcpy(&value, &bits, 4);
+            values.push_back(value);
+        }
+
+        return values;
+    }
+
+    void test_float_formats()
+    {
+        /* Two rows of three values */
+        const std::vector<float> values = { 0.0f, 0.25f, 0.5f, 1.0f, 2.0f, 1e-3f };
+
+        FILE* pfm = std::tmpfile();
+        CHECK(pfm != nullptr && write_pfm(pfm, 3, 2, values.data()));
+
+        const std::string header = "Pf\n3 2\n-1.0\n";
+        const std::vector<uint8_t> pfm_data = pfm ? read_back(pfm) : std::vector<uint8_t>();
+
+        CHECK(pfm_data.size() == header.size() + 4 * values.size() && std::equal(header.begin(), header.end(), pfm_data.begin()));
+
+        /* PFM stores the bottom row first */
+        const std::vector<float> bottom_up = { 1.0f, 2.0f, 1e-3f, 0.0f, 0.25f, 0.5f };
+        CHECK(get_floats_le(pfm_data, header.size()) == bottom_up);
+
+        FILE* raw = std::tmpfile();
+        CHECK(raw != nullptr && write_raw_float(raw, 3, 2, values.data()));
+        CHECK(get_floats_le(raw ? read_back(raw) : std::vector<uint8_t>(), 0) == values);
+    }
+
+    void test_format_names()
+    {
+        std::string filename = "diff.qoi";
+        OutputFormat format = OutputFormat::Png;
+
+        CHECK(split_output_extension(filename, format) && filename == "diff" && format == OutputFormat::Qoi);
+
+        filename = "diff.jpg";
+        CHECK(!split_output_extension(filename, format) && filename == "diff.jpg");
+
+        CHECK(output_format_from_name("pfm", format) && format == OutputFormat::Pfm);
+        CHECK(!output_format_from_name("bmp", format));
+        CHECK(std::string(output_format_extension(OutputFormat::Raw)) == ".raw");
+        CHECK(is_float_output_format(OutputFormat::Raw) && !is_float_output_format(OutputFormat::Ppm));
+    }
+}
+
+int main()
+{
+    test_qoi();
+    test_ppm();
+    test_float_formats();
+    test_format_names();
+
+    return check_failures() != 0;
+}
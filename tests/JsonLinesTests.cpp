@@ -0,0 +1,160 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* The JSON Lines reader and writer used by --batch */
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <string>
+
+#include "Check.hpp"
+#include "JsonLines.hpp"
+
+namespace
+{
+    using Fields = std::map<std::string, JsonValue>;
+
+    bool parses(const std::string& text, Fields& fields)
+    {
+        std::string error;
+        const bool ok = parse_json_object(text, fields, error);
+
+        CHECK(ok == error.empty());
+
+        return ok;
+    }
+
+    /* The error message, empty if text parsed */
+    std::string parse_error(const std::string& text)
+    {
+        Fields fields;
+        std::string error;
+
+        parse_json_object(text, fields, error);
+
+        return error;
+    }
+
+    bool has_field(const Fields& fields, const std::string& key, JsonValue::Type type, const std::string& text)
+    {
+        const auto it = fields.find(key);
+
+        return it != fields.end() && it->second.type == type && it->second.text == text;
+    }
+
+    void test_values()
+    {
+        Fields fields;
+
+        CHECK(parses(" { \"ref\" : \"a.png\",\t\"n\":-12.5e+3, \"zero\":0, \"yes\":true, \"no\":false, \"none\":null }\r\n", fields));
+        CHECK(fields.size() == 6);
+        CHECK(has_field(fields, "ref", JsonValue::Type::String, "a.png"));
+        CHECK(has_field(fields, "n", JsonValue::Type::Number, "-12.5e+3"));
+        CHECK(has_field(fields, "zero", JsonValue::Type::Number, "0"));
+        CHECK(has_field(fields, "yes", JsonValue::Type::Bool, "true"));
+        CHECK(has_field(fields, "no", JsonValue::Type::Bool, "false"));
+        CHECK(has_field(fields, "none", JsonValue::Type::Null, ""));
+
+        Fields empty;
+        CHECK(parses("{}", empty));
+        CHECK(empty.empty());
+
+        /* The last duplicate key wins */
+        Fields duplicates;
+        CHECK(parses("{\"a\":\"1\",\"a\":\"2\"}", duplicates));
+        CHECK(has_field(duplicates, "a", JsonValue::Type::String, "2"));
+    }
+
+    void test_escapes()
+    {
+        Fields fields;
+
+        CHECK(parses("{\"s\":\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"}", fields));
+        CHECK(has_field(fields, "s", JsonValue::Type::String, "\"\\/\b\f\n\r\t"));
+
+        /* \u escapes are stored as UTF-8, surrogate pairs are combined */
+        CHECK(parses("{\"s\":\"\\u0041\\u00e9\\u20AC\\ud83d\\ude00\"}", fields));
+        CHECK(has_field(fields, "s", JsonValue::Type::String, "A\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80"));
+
+        /* UTF-8 in the input is copied as it is */
+        CHECK(parses("{\"s\":\"\xC3\xA9\"}", fields));
+        CHECK(has_field(fields, "s", JsonValue::Type::String, "\xC3\xA9"));
+    }
+
+    void test_errors()
+    {
+        for (const char* text : { "", "[]", "{", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "{\"a\":1 \"b\":2}", "{a:1}", "{\"a\":1} x",
+                                  "{\"a\":{}}", "{\"a\":[1]}", "{\"a\":01}", "{\"a\":1.}", "{\"a\":-}", "{\"a\":1e}", "{\"a\":tru}",
+                                  "{\"a\":\"unterminated}", "{\"a\":\"\\x\"}", "{\"a\":\"\\u12\"}", "{\"a\":\"\\u12g4\"}",
+                                  "{\"a\":\"\\ud83d\"}", "{\"a\":\"\\ud83d\\u0041\"}", "{\"a\":\"\\ude00\"}", "{\"a\":\"tab\there\"}" })
+        {
+            if (parse_error(text).empty())
+            {
+                std::cerr << "Parsed invalid JSON: " << text << "\n";
+                ++check_failures();
+            }
+        }
+
+        CHECK(parse_error("{\"a\":}") == "invalid value at column 6");
+        CHECK(parse_error("{\"a\":[1]}") == "nested objects and arrays aren't supported at column 6");
+    }
+
+    void test_writer()
+    {
+        JsonObjectWriter writer;
+        writer.add_string("path", "dir\\a \"b\"\n\x01")
+              .add_integer("count", -3)
+              .add_bool("ok", true)
+              .add_number("third", 1.0 / 3.0)
+              .add_number("tenth", 0.1)
+              .add_number("nan", std::numeric_limits<double>::quiet_NaN());
+
+        CHECK(writer.str() == "{\"path\":\"dir\\\\a \\\"b\\\"\\n\\u0001\",\"count\":-3,\"ok\":true,"
+                              "\"third\":0.33333333333333331,\"tenth\":0.1,\"nan\":null}");
+
+        /* Whatever the writer produces reads back as the same values */
+        Fields fields;
+
+        CHECK(parses(writer.str(), fields));
+        CHECK(has_field(fields, "path", JsonValue::Type::String, "dir\\a \"b\"\n\x01"));
+        CHECK(has_field(fields, "count", JsonValue::Type::Number, "-3"));
+        CHECK(has_field(fields, "ok", JsonValue::Type::Bool, "true"));
+        CHECK(has_field(fields, "nan", JsonValue::Type::Null, ""));
+        CHECK(fields.count("third") == 1 && std::strtod(fields["third"].text.c_str(), nullptr) == 1.0 / 3.0);
+
+        CHECK(JsonObjectWriter().str() == "{}");
+    }
+}
+
+int main()
+{
+    test_values();
+    test_escapes();
+    test_errors();
+    test_writer();
+
+    return check_failures() != 0;
+}
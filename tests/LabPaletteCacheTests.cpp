@@ -0,0 +1,126 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Auto palette cache mode decides the same whether the reference is passed to compare() or prepared
+ * once, and both paths give the same delta E
+ */
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Check.hpp"
+#include "Image.hpp"
+#include "LabComparator.hpp"
+
+namespace
+{
+    constexpr unsigned width  = 256;
+    constexpr unsigned height = 256;
+
+    /* num_colors distinct colors repeated across the image */
+    std::vector<uint8_t> palette_image(uint32_t num_colors)
+    {
+        std::vector<uint8_t> rgb(size_t(width) * height * 3);
+
+        for (size_t i = 0; i < size_t(width) * height; ++i)
+        {
+            const uint32_t color = uint32_t(i % num_colors) * 2654435761u;
+
+            rgb[3 * i + 0] = uint8_t(color);
+            rgb[3 * i + 1] = uint8_t(color >> 8);
+            rgb[3 * i + 2] = uint8_t(color >> 16);
+        }
+
+        return rgb;
+    }
+
+    struct Outcome
+    {
+        double delta_e;
+        std::string stats;
+    };
+
+    Outcome compare(const std::vector<uint8_t>& ref, const std::vector<uint8_t>& src, bool prepared)
+    {
+        LabComparator<double> comparator(tinycolormap::ColormapType::Hot, "unused", width, height, -1, PaletteCacheMode::Auto);
+
+        if (prepared)
+        {
+            comparator.compare(*comparator.prepare_reference(ref), src);
+        }
+        else
+        {
+            comparator.compare(ref, src);
+        }
+
+        std::ostringstream stats;
+        comparator.print_stats(stats);
+
+        return { comparator.get_error(), stats.str() };
+    }
+
+    void check_same_decision(const std::vector<uint8_t>& ref, const std::vector<uint8_t>& src, bool expect_cache)
+    {
+        const Outcome direct   = compare(ref, src, false);
+        const Outcome prepared = compare(ref, src, true);
+
+        /* The prepared path only looks up the source, so only whether the cache was used is comparable */
+        CHECK(direct.delta_e == prepared.delta_e);
+        CHECK((direct.stats != "Palette cache: off\n") == expect_cache);
+        CHECK((prepared.stats != "Palette cache: off\n") == expect_cache);
+    }
+
+    void test_sample_decision()
+    {
+        const std::vector<uint8_t> few  = palette_image(16);
+        const std::vector<uint8_t> many = palette_image(20000);
+
+        CHECK(LabPaletteCache<double>::is_low_palette(few, few));
+        CHECK(!LabPaletteCache<double>::is_low_palette(few, many));
+
+        /* The sample overload decides like the image one */
+        CHECK(LabPaletteCache<double>::is_low_palette(LabPaletteCache<double>::sample_colors(few), LabPaletteCache<double>::sample_colors(few)));
+        CHECK(!LabPaletteCache<double>::is_low_palette(LabPaletteCache<double>::sample_colors(many), LabPaletteCache<double>::sample_colors(few)));
+    }
+}
+
+int main()
+{
+    test_sample_decision();
+
+    const std::vector<uint8_t> few   = palette_image(16);
+    const std::vector<uint8_t> other = palette_image(12);
+    const std::vector<uint8_t> many  = palette_image(20000);
+
+    check_same_decision(few, other, true);
+
+    /* A many-colored reference rules the cache out even when the source has few colors */
+    check_same_decision(many, few, false);
+    check_same_decision(few, many, false);
+
+    return check_failures() != 0;
+}
@@ -0,0 +1,247 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * End-to-end regression tests on 1a.png and 1b.png: the metrics of every mode and precision, and the
+ * diff images against 1diff_luma.png and 1diff_lab.png, which were written by the original double
+ * precision implementation with the default settings (Hot colormap, no interpolation). That one called
+ * tinycolormap::GetColor per pixel, ColormapLut may be one level off from it.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include "BaseComparator.hpp"
+#include "Check.hpp"
+#include "FixedPointLumaComparator.hpp"
+#include "Image.hpp"
+#include "ImageComparison.hpp"
+#include "MappedFile.hpp"
+
+namespace
+{
+    /* Metrics of the double precision path */
+    constexpr double expected_mse     = 0.0035114227690378123;
+    constexpr double expected_delta_e = 15.118007617540481;
+
+    std::string g_data_dir;
+    std::string g_output_dir;
+
+    std::string data_path(const std::string& name)
+    {
+        return g_data_dir + "/" + name;
+    }
+
+    std::string output_path(const std::string& name)
+    {
+        return g_output_dir + "/" + name;
+    }
+
+    /* Decodes an image file to 8-bit RGB, the image is empty if it couldn't be read */
+    Image decode_file(const std::string& filename, ImageMetadata& metadata)
+    {
+        MappedFile file(filename);
+
+        if (!file.is_open())
+        {
+            return Image();
+        }
+
+        return BaseComparator::decode_image(ImageView(file.data(), file.size()), metadata);
+    }
+
+    /* Largest difference of a channel between two decoded images, -1 if they can't be compared */
+    int max_channel_difference(const std::string& a_filename, const std::string& b_filename)
+    {
+        ImageMetadata a_metadata;
+        ImageMetadata b_metadata;
+
+        const Image a = decode_file(a_filename, a_metadata);
+        const Image b = decode_file(b_filename, b_metadata);
+
+        if (a.empty() || b.empty() || a_metadata.width != b_metadata.width || a_metadata.height != b_metadata.height)
+        {
+            return -1;
+        }
+
+        int max_difference = 0;
+
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            max_difference = std::max(max_difference, std::abs(int(a.data()[i]) - int(b.data()[i])));
+        }
+
+        return max_difference;
+    }
+
+    /* Whether the images differ by at most one level per channel */
+    bool within_one_level(const std::string& a_filename, const std::string& b_filename)
+    {
+        const int difference = max_channel_difference(a_filename, b_filename);
+
+        return difference >= 0 && difference <= 1;
+    }
+
+    ComparisonResult compare(const std::string& mode, const std::string& precision, const std::string& out_filename,
+                             OutputFormat output_format = OutputFormat::Png)
+    {
+        ComparisonSettings settings;
+        settings.mode          = mode;
+        settings.precision     = precision;
+        settings.output_format = output_format;
+
+        const MappedFile ref_file(data_path("1a.png"));
+        const MappedFile src_file(data_path("1b.png"));
+
+        return compare_images("1a.png", ref_file, "1b.png", src_file, output_path(out_filename), settings);
+    }
+
+    void test_luma()
+    {
+        const ComparisonResult result = compare("Luma", "double", "luma_double");
+
+        CHECK(result.ok);
+        CHECK(result.saved);
+        CHECK(!result.identical);
+        CHECK(result.width == 600 && result.height == 600);
+        CHECK_NEAR(result.error, expected_mse, 1e-15);
+        CHECK(within_one_level(output_path("luma_double.png"), data_path("1diff_luma.png")));
+
+        /* Float and fixed-point rounding move a few pixels across a colormap step */
+        const ComparisonResult float_result = compare("Luma", "float", "luma_float");
+
+        CHECK(float_result.ok);
+        CHECK_NEAR(float_result.error, expected_mse, 1e-9);
+        CHECK(within_one_level(output_path("luma_float.png"), output_path("luma_double.png")));
+
+        const ComparisonResult fixed_result = compare("Luma", "fixed", "luma_fixed");
+
+        CHECK(fixed_result.ok);
+        /* The bound documented in FixedPointLumaComparator.hpp, about 2e-6 of the MSE here */
+        constexpr double unit = FixedPointLumaComparator::unit;
+        CHECK_NEAR(fixed_result.error, expected_mse, (2.0 * std::sqrt(expected_mse) + 1.0 / unit) / unit);
+        CHECK(within_one_level(output_path("luma_fixed.png"), output_path("luma_double.png")));
+    }
+
+    void test_lab()
+    {
+        const ComparisonResult result = compare("Lab", "double", "lab_double");
+
+        CHECK(result.ok);
+        CHECK(result.saved);
+        CHECK_NEAR(result.error, expected_delta_e, 1e-12);
+        CHECK(within_one_level(output_path("lab_double.png"), data_path("1diff_lab.png")));
+
+        /* The default precision is the one that reproduces the reference metrics */
+        CHECK(ComparisonSettings().precision == "double");
+
+        /* Float rounding moves a few pixels across a colormap step */
+        const ComparisonResult float_result = compare("Lab", "float", "lab_float");
+
+        CHECK(float_result.ok);
+        CHECK_NEAR(float_result.error, expected_delta_e, 1e-4);
+        CHECK(within_one_level(output_path("lab_float.png"), output_path("lab_double.png")));
+    }
+
+    /* PPM holds the same pixels as PNG, stb_image reads both */
+    void test_ppm_output()
+    {
+        const ComparisonResult result = compare("Luma", "double", "luma_double_ppm", OutputFormat::Ppm);
+
+        CHECK(result.ok);
+        CHECK(max_channel_difference(output_path("luma_double_ppm.ppm"), output_path("luma_double.png")) == 0);
+    }
+
+    /* A shared reference gives the same metric and image as decoding both inputs */
+    void test_shared_reference()
+    {
+        for (const char* mode : { "Luma", "Lab" })
+        {
+            ComparisonSettings settings;
+            settings.mode      = mode;
+            settings.precision = "double";
+
+            std::string error;
+            const auto reference = SharedReference::create("1a.png", MappedFile(data_path("1a.png")), 8, settings, error);
+
+            CHECK(reference != nullptr);
+
+            if (!reference)
+            {
+                continue;
+            }
+
+            const std::string out_filename = output_path(std::string("shared_") + mode);
+
+            ImageComparison comparison(reference, "1b.png", out_filename, settings);
+            const MappedFile src_file(data_path("1b.png"));
+
+            CHECK(comparison.decode(src_file) && comparison.compare() && comparison.save());
+            CHECK_NEAR(comparison.result().error, std::string(mode) == "Luma" ? expected_mse : expected_delta_e, 1e-12);
+            CHECK(max_channel_difference(out_filename + ".png", output_path(std::string(mode) == "Luma" ? "luma_double.png" : "lab_double.png")) == 0);
+        }
+    }
+
+    void test_identical_inputs()
+    {
+        ComparisonSettings settings;
+        settings.skip_identical_output = true;
+
+        const MappedFile ref_file(data_path("1a.png"));
+        const MappedFile src_file(data_path("1a.png"));
+
+        const ComparisonResult result = compare_images("1a.png", ref_file, "1a.png", src_file, output_path("identical"), settings);
+
+        CHECK(result.ok);
+        CHECK(result.identical);
+        CHECK(!result.saved);
+        CHECK(result.error == 0.0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: RegressionTests <directory of the test images> <output directory>\n";
+        return 2;
+    }
+
+    g_data_dir   = argv[1];
+    g_output_dir = argv[2];
+
+    std::filesystem::create_directories(g_output_dir);
+
+    test_luma();
+    test_lab();
+    test_ppm_output();
+    test_shared_reference();
+    test_identical_inputs();
+
+    return check_failures() != 0;
+}
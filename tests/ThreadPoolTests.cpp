@@ -0,0 +1,108 @@
+/*
+MIT License
+
+Copyright (c) 2020 Tomasz Gałaj
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* ThreadPool: every task runs exactly once, with nested loops and several callers at once */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.hpp"
+#include "ThreadPool.hpp"
+
+namespace
+{
+    void test_every_task_once(ThreadPool& pool)
+    {
+        for (size_t num_tasks : { 0, 1, 2, 3, 17, 1000 })
+        {
+            std::vector<std::atomic<int>> calls(num_tasks);
+
+            pool.parallel_for(num_tasks, [&](size_t i) { ++calls[i]; });
+
+            bool once = true;
+
+            for (const auto& count : calls)
+            {
+                once = once && count.load() == 1;
+            }
+
+            CHECK(once);
+        }
+    }
+
+    void test_nested(ThreadPool& pool)
+    {
+        std::atomic<size_t> sum(0);
+
+        pool.parallel_for(16, [&](size_t i)
+        {
+            pool.parallel_for(64, [&](size_t j) { sum += i * 64 + j; });
+        });
+
+        /* 0 + 1 + ... + 1023 */
+        CHECK(sum.load() == 1023 * 1024 / 2);
+    }
+
+    /* Loops started from threads outside the pool share its queue */
+    void test_concurrent_callers(ThreadPool& pool)
+    {
+        std::atomic<size_t> count(0);
+        std::vector<std::thread> callers;
+
+        for (int t = 0; t < 4; ++t)
+        {
+            callers.emplace_back([&]
+            {
+                for (int round = 0; round < 50; ++round)
+                {
+                    pool.parallel_for(100, [&](size_t) { ++count; });
+                }
+            });
+        }
+
+        for (auto& caller : callers)
+        {
+            caller.join();
+        }
+
+        CHECK(count.load() == 4 * 50 * 100);
+    }
+}
+
+int main()
+{
+    for (unsigned num_threads : { 1u, 2u, 4u })
+    {
+        ThreadPool pool(num_threads);
+
+        CHECK(pool.size() == num_threads);
+
+        test_every_task_once(pool);
+        test_nested(pool);
+        test_concurrent_callers(pool);
+    }
+
+    return check_failures() != 0;
+}